@@ -1,133 +1,323 @@
 #ifndef MDFS_BLOCK_DEVICE_H
 #define MDFS_BLOCK_DEVICE_H
 
+#include <algorithm>
 #include <cassert>
 #include <common/align.hpp>
+#include <common/gpt.hpp>
+#include <common/io_engine.hpp>
 #include <common/units.hpp>
 #include <cstring>
-#include <fstream>
+#include <ios>
+#include <memory>
+#include <span>
+#include <mutex>
 #include <stdexcept>
 #include <string>
+#include <vector>
 
 namespace mdfs {
+// collects sector aligned writes so a BlockDevice can commit them together. the buffers have to stay alive until
+// the batch is submitted
+class WriteBatch {
+public:
+	void add(size_t LBA, const void *data, size_t sizeInLBA) {
+		if (sizeInLBA == 0) { return; }
+		m_extents.push_back({.LBA = LBA, .data = static_cast<const char *>(data), .sizeInLBA = sizeInLBA});
+	}
+	void clear() { m_extents.clear(); }
+	bool empty() const { return m_extents.empty(); }
+
+	// extents ordered by LBA, so engines can merge the adjacent ones into single requests
+	std::span<const IoExtent> sorted() {
+		std::stable_sort(m_extents.begin(), m_extents.end(),
+						 [](const IoExtent &a, const IoExtent &b) { return a.LBA < b.LBA; });
+		for (size_t i = 1; i < m_extents.size(); i++) {
+			assert(m_extents[i - 1].LBA + m_extents[i - 1].sizeInLBA <= m_extents[i].LBA);
+		}
+		return m_extents;
+	}
+
+private:
+	std::vector<IoExtent> m_extents;
+};
+
+// the positional read_lba/write_lba/zero_range overloads can be used from any number of threads at once, they are
+// passed straight through for thread safe engines and serialized otherwise. the cursor based calls are not thread safe
 class BlockDevice {
 public:
 	BlockDevice() {}
 	BlockDevice(std::string path, size_t blockSize = 512,
-				std::ios_base::openmode openmode = std::ios::in | std::ios::out) {
-		open(path, blockSize, openmode);
-	}
-	~BlockDevice() {
-		if (m_file.is_open()) { m_file.close(); }
+				std::ios_base::openmode openmode = std::ios::in | std::ios::out,
+				const IoEngineOptions &ioOptions = IoEngineOptions()) {
+		open(path, blockSize, openmode, ioOptions);
 	}
+	~BlockDevice() { close(); }
 
-	void open(std::string path, size_t blockSize, std::ios_base::openmode openmode) {
+	void open(std::string path, size_t blockSize, std::ios_base::openmode openmode,
+			  const IoEngineOptions &ioOptions = IoEngineOptions()) {
+		close();
 		m_openmode = openmode;
 		m_blockSize = blockSize;
-		m_file.open(path, std::ios::in | std::ios::out | std::ios::binary);
-		if (!m_file.is_open()) { throw std::runtime_error("Failed to open image"); }
-		m_file.seekg(0, std::ios::end);
-		m_fileSize = mdfs::align_down<size_t>(m_file.tellg(), m_blockSize);
-		m_file.seekg(0);
-		if (!m_file.is_open()) { throw std::runtime_error("Failed to open image"); }
+		m_engine = mdfs::make_io_engine(ioOptions);
+		m_engine->open(path, blockSize, openmode);
+		m_fileSize = mdfs::align_down<size_t>(m_engine->size_b(), m_blockSize);
 	}
 
 	void close() {
-		if (m_file.is_open()) { m_file.close(); }
+		if (m_engine) {
+			m_engine->close();
+			m_engine.reset();
+		}
 		m_blockSize = 512;
 		m_fileSize = 0;
+		m_getLBA = 0;
+		m_putLBA = 0;
 	}
 
-	void flush() { m_file.flush(); }
+	void flush() {
+		if (m_engine) { m_engine->flush(); }
+	}
 
 	void seekg(size_t LBA) {
 		if (!(m_openmode & std::ios::in)) { return; }
 		assert(LBA < size_lba());
-		m_file.seekg(mdfs::lba_to_addr(LBA, m_blockSize));
+		m_getLBA = LBA;
 	}
 	void seekp(size_t LBA) {
 		if (!(m_openmode & std::ios::out)) { return; }
 		assert(LBA < size_lba());
-		m_file.seekp(mdfs::lba_to_addr(LBA, m_blockSize));
+		m_putLBA = LBA;
 	}
 
 	size_t tellg() {
 		if (!(m_openmode & std::ios::in)) { return 0; }
-		return mdfs::addr_to_lba(m_file.tellg(), m_blockSize);
+		return m_getLBA;
 	}
 	size_t tellp() {
 		if (!(m_openmode & std::ios::out)) { return 0; }
-		return mdfs::addr_to_lba(m_file.tellp(), m_blockSize);
+		return m_putLBA;
 	}
 
+	// reads size bytes at the get cursor and advances it past every sector touched
 	void read(char *data, size_t size) {
 		if (size == 0) { return; }
 		if (!(m_openmode & std::ios::in)) { return; }
-		size_t sizeInLBA = mdfs::align_up(size, m_blockSize) / m_blockSize;
-		char *tempData = new char[sizeInLBA * m_blockSize];
-		read_lba(tempData, sizeInLBA);
-		memcpy(data, tempData, size);
-		delete[] tempData;
+		read_at(mdfs::lba_to_addr(m_getLBA, m_blockSize), data, size);
+		m_getLBA += mdfs::align_up(size, m_blockSize) / m_blockSize;
 	}
+	// writes size bytes at the put cursor and advances it past every sector touched. the rest of a partially
+	// written sector keeps its previous contents
 	void write(const char *data, size_t size) {
 		if (size == 0) { return; }
 		if (!(m_openmode & std::ios::out)) { return; }
-		size_t sizeInLBA = mdfs::align_up(size, m_blockSize) / m_blockSize;
-		char *tempData = new char[sizeInLBA * m_blockSize];
-		memcpy(tempData, data, size);
-		memset(tempData + size, 0x00, (sizeInLBA * m_blockSize) - size);
-		write_lba(tempData, sizeInLBA);
-		delete[] tempData;
+		write_at(mdfs::lba_to_addr(m_putLBA, m_blockSize), data, size);
+		m_putLBA += mdfs::align_up(size, m_blockSize) / m_blockSize;
 	}
 
+	// byte addressed transfers. whole sectors go straight between the caller's buffer and the engine, partial
+	// sectors at either end are read-modify-written through the per-device scratch sector
+	void read_at(uint64_t offset, void *data, size_t size) {
+		if (size == 0) { return; }
+		if (!(m_openmode & std::ios::in)) { return; }
+		assert(offset + size <= size_b());
+		partial_transfer(offset, static_cast<char *>(data), size, false);
+	}
+	void write_at(uint64_t offset, const void *data, size_t size) {
+		if (size == 0) { return; }
+		if (!(m_openmode & std::ios::out)) { return; }
+		assert(offset + size <= size_b());
+		partial_transfer(offset, static_cast<char *>(const_cast<void *>(data)), size, true);
+	}
+	// same, feeding the written bytes into crc while they are copied towards the image
+	void write_at(uint64_t offset, const void *data, size_t size, Crc32 &crc) {
+		if (size == 0) { return; }
+		if (!(m_openmode & std::ios::out)) { return; }
+		assert(offset + size <= size_b());
+		partial_transfer(offset, static_cast<char *>(const_cast<void *>(data)), size, true, &crc);
+	}
 
 	void read_lba(char *data, size_t sizeInLBA) {
 		if (sizeInLBA == 0) { return; }
 		if (!(m_openmode & std::ios::in)) { return; }
-		auto pos = m_file.tellg();
-		assert(pos >= 0);
-		assert((sizeInLBA + pos / m_blockSize) <= size_lba());
-		m_file.read(data, mdfs::lba_to_addr(sizeInLBA, m_blockSize));
+		assert((sizeInLBA + m_getLBA) <= size_lba());
+		read_lba(m_getLBA, data, sizeInLBA);
+		m_getLBA += sizeInLBA;
 	}
 	void write_lba(const char *data, size_t sizeInLBA) {
 		if (sizeInLBA == 0) { return; }
 		if (!(m_openmode & std::ios::out)) { return; }
-		auto pos = m_file.tellp();
-		assert(pos >= 0);
-		assert((sizeInLBA + pos / m_blockSize) <= size_lba());
-		m_file.write(data, mdfs::lba_to_addr(sizeInLBA, m_blockSize));
+		assert((sizeInLBA + m_putLBA) <= size_lba());
+		write_lba(m_putLBA, data, sizeInLBA);
+		m_putLBA += sizeInLBA;
 	}
 
 	void read_lba(size_t LBA, char *data, size_t sizeInLBA) {
 		if (sizeInLBA == 0) { return; }
 		if (!(m_openmode & std::ios::in)) { return; }
 		assert((LBA + sizeInLBA) <= size_lba());
-		size_t currentPos = m_file.tellg();
-		m_file.seekg(mdfs::lba_to_addr(LBA, m_blockSize));
-		m_file.read(data, mdfs::lba_to_addr(sizeInLBA, m_blockSize));
-		m_file.seekg(currentPos);
+		auto lock = serialize();
+		m_engine->read_lba(LBA, data, sizeInLBA);
 	}
 	void write_lba(size_t LBA, const char *data, size_t sizeInLBA) {
 		if (sizeInLBA == 0) { return; }
 		if (!(m_openmode & std::ios::out)) { return; }
 		assert((LBA + sizeInLBA) <= size_lba());
-		size_t currentPos = m_file.tellp();
-		m_file.seekp(mdfs::lba_to_addr(LBA, m_blockSize));
-		m_file.write(data, sizeInLBA * m_blockSize);
-		m_file.seekp(currentPos);
+		auto lock = serialize();
+		m_engine->write_lba(LBA, data, sizeInLBA);
+	}
+
+	// writes every extent of the batch in as few requests as the engine allows, adjacent extents are merged
+	void submit(WriteBatch &batch) {
+		if (batch.empty()) { return; }
+		if (!(m_openmode & std::ios::out)) { return; }
+		std::span<const IoExtent> extents = batch.sorted();
+		assert(extents.back().LBA + extents.back().sizeInLBA <= size_lba());
+		auto lock = serialize();
+		m_engine->write_batch(extents);
+	}
+
+	// zeroes sizeInLBA sectors starting at LBA, letting the engine offload it to the kernel where possible
+	void zero_range(size_t LBA, size_t sizeInLBA) {
+		if (sizeInLBA == 0) { return; }
+		if (!(m_openmode & std::ios::out)) { return; }
+		assert((LBA + sizeInLBA) <= size_lba());
+		auto lock = serialize();
+		m_engine->zero_lba(LBA, sizeInLBA);
+	}
+	// zeroes sizeInLBA sectors starting at LBA by streaming a fixed size zero buffer, regardless of the length
+	void zero_lba(size_t LBA, size_t sizeInLBA) {
+		if (sizeInLBA == 0) { return; }
+		if (!(m_openmode & std::ios::out)) { return; }
+		assert((LBA + sizeInLBA) <= size_lba());
+		// the shared zero buffer of the streaming path is always serialized
+		std::lock_guard lock(m_mutex);
+		m_engine->IoEngine::zero_lba(LBA, sizeInLBA);
+	}
+
+	// zero-copy view over sizeInLBA sectors starting at LBA, throws if the engine isn't backed by a mapping.
+	// the view stays valid until the device is closed
+	std::span<std::byte> span_lba(size_t LBA, size_t sizeInLBA) {
+		assert((LBA + sizeInLBA) <= size_lba());
+		std::span<std::byte> span = m_engine->map_lba(LBA, sizeInLBA);
+		if (span.size() != mdfs::lba_to_addr(sizeInLBA, m_blockSize)) {
+			throw std::runtime_error(std::string("The ") + m_engine->name() + " engine can't map sectors");
+		}
+		return span;
+	}
+
+	// overlays a structure on the mapping at LBA, plus an optional byte offset into the sector
+	template<typename T>
+	T *view(size_t LBA, size_t offset = 0) {
+		size_t sizeInLBA = mdfs::align_up(offset + sizeof(T), m_blockSize) / m_blockSize;
+		return reinterpret_cast<T *>(span_lba(LBA, sizeInLBA).data() + offset);
+	}
+	template<typename T>
+	std::span<T> view_array(size_t LBA, size_t count) {
+		size_t sizeInLBA = mdfs::align_up(count * sizeof(T), m_blockSize) / m_blockSize;
+		return std::span<T>(reinterpret_cast<T *>(span_lba(LBA, sizeInLBA).data()), count);
+	}
+
+	mdfs::mbr::MBR *mbr() { return view<mdfs::mbr::MBR>(0); }
+	mdfs::HeaderGPT *gpt_header(size_t LBA) { return view<mdfs::HeaderGPT>(LBA); }
+	std::span<mdfs::PartitionEntryGPT> gpt_entries(size_t LBA, size_t count) {
+		return view_array<mdfs::PartitionEntryGPT>(LBA, count);
+	}
+
+	// makes everything written so far durable, including edits made through views. sizeInLBA of 0 syncs everything
+	// from LBA on
+	void sync(size_t LBA = 0, size_t sizeInLBA = 0) { m_engine->sync_lba(LBA, sizeInLBA); }
+	void advise(AccessPattern pattern, size_t LBA = 0, size_t sizeInLBA = 0) {
+		m_engine->advise(pattern, LBA, sizeInLBA);
 	}
 
 	size_t size_lba() { return m_fileSize / m_blockSize; }
 	size_t size_b() { return m_fileSize; }
 	size_t block_size() { return m_blockSize; }
-	void set_block_size(size_t newSize) { m_blockSize = newSize; }
+	void set_block_size(size_t newSize) {
+		m_blockSize = newSize;
+		if (m_engine) { m_engine->set_block_size(newSize); }
+	}
+
+	IoEngine *engine() { return m_engine.get(); }
 
 private:
-	std::fstream m_file;
+	void partial_transfer(uint64_t offset, char *data, size_t size, bool write, Crc32 *crc = nullptr) {
+		while (size > 0) {
+			size_t LBA = offset / m_blockSize;
+			size_t inSector = offset % m_blockSize;
+			size_t chunk;
+			if (inSector == 0 && size >= m_blockSize) {
+				size_t sizeInLBA = size / m_blockSize;
+				chunk = mdfs::lba_to_addr(sizeInLBA, m_blockSize);
+				auto lock = serialize();
+				if (write && crc) {
+					m_engine->write_lba_crc(LBA, data, sizeInLBA, *crc);
+				} else if (write) {
+					m_engine->write_lba(LBA, data, sizeInLBA);
+				} else {
+					m_engine->read_lba(LBA, data, sizeInLBA);
+				}
+			} else {
+				chunk = std::min(size, m_blockSize - inSector);
+				transfer_sector_part(LBA, inSector, data, chunk, write, crc);
+			}
+			offset += chunk;
+			data += chunk;
+			size -= chunk;
+		}
+	}
+
+	void transfer_sector_part(size_t LBA, size_t inSector, char *data, size_t size, bool write,
+							  Crc32 *crc = nullptr) {
+		// mapped engines are patched in place, no copy of the sector needed
+		std::span<std::byte> mapped = m_engine->map_lba(LBA, 1);
+		if (!mapped.empty()) {
+			if (write && crc) {
+				crc->copy_and_update(mapped.data() + inSector, data, size);
+			} else if (write) {
+				memcpy(mapped.data() + inSector, data, size);
+			} else {
+				memcpy(data, mapped.data() + inSector, size);
+			}
+			return;
+		}
+
+		std::lock_guard scratchLock(m_scratchMutex);
+		if (m_scratchSize < m_blockSize) {
+			m_scratch = std::make_unique<char[]>(m_blockSize);
+			m_scratchSize = m_blockSize;
+		}
+		auto lock = serialize();
+		m_engine->read_lba(LBA, m_scratch.get(), 1);
+		if (write && crc) {
+			crc->copy_and_update(m_scratch.get() + inSector, data, size);
+			m_engine->write_lba(LBA, m_scratch.get(), 1);
+		} else if (write) {
+			memcpy(m_scratch.get() + inSector, data, size);
+			m_engine->write_lba(LBA, m_scratch.get(), 1);
+		} else {
+			memcpy(data, m_scratch.get() + inSector, size);
+		}
+	}
+
+	std::unique_lock<std::mutex> serialize() {
+		if (m_engine->thread_safe()) { return std::unique_lock<std::mutex>(); }
+		return std::unique_lock<std::mutex>(m_mutex);
+	}
+
+	std::unique_ptr<IoEngine> m_engine;
+	std::mutex m_mutex;
+	// sector used for read-modify-write of partial sectors, allocated once and reused for every transfer
+	std::unique_ptr<char[]> m_scratch;
+	size_t m_scratchSize = 0;
+	std::mutex m_scratchMutex;
 	size_t m_blockSize = 512;
 	size_t m_fileSize = 0;
+	size_t m_getLBA = 0;
+	size_t m_putLBA = 0;
 	std::ios_base::openmode m_openmode;
 };
 }// namespace mdfs
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,63 @@
+#ifndef MDFS_BUFFER_POOL_H
+#define MDFS_BUFFER_POOL_H
+
+#include <common/align.hpp>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdlib>
+#include <mutex>
+#include <new>
+#include <vector>
+
+namespace mdfs {
+// fixed set of equally sized buffers carved out of one allocation, every buffer starts on an alignment boundary.
+// alignment must be a power of two
+class AlignedBufferPool {
+public:
+	AlignedBufferPool() {}
+	AlignedBufferPool(size_t count, size_t bufferSize, size_t alignment) { allocate(count, bufferSize, alignment); }
+	~AlignedBufferPool() { free(m_memory); }
+	AlignedBufferPool(const AlignedBufferPool &) = delete;
+	AlignedBufferPool &operator=(const AlignedBufferPool &) = delete;
+
+	void allocate(size_t count, size_t bufferSize, size_t alignment) {
+		free(m_memory);
+		m_bufferSize = mdfs::align_up(bufferSize, alignment);
+		m_count = count;
+		m_memory = static_cast<char *>(aligned_alloc(alignment, m_bufferSize * m_count));
+		if (!m_memory && m_count != 0) { throw std::bad_alloc(); }
+		m_free.clear();
+		for (size_t i = m_count; i > 0; i--) { m_free.push_back(i - 1); }
+	}
+
+	// blocks until a buffer is free
+	size_t acquire() {
+		std::unique_lock lock(m_mutex);
+		m_available.wait(lock, [this]() { return !m_free.empty(); });
+		size_t index = m_free.back();
+		m_free.pop_back();
+		return index;
+	}
+	void release(size_t index) {
+		{
+			std::lock_guard lock(m_mutex);
+			m_free.push_back(index);
+		}
+		m_available.notify_one();
+	}
+
+	char *buffer(size_t index) { return m_memory + index * m_bufferSize; }
+	size_t buffer_size() const { return m_bufferSize; }
+	size_t count() const { return m_count; }
+
+private:
+	char *m_memory = nullptr;
+	size_t m_bufferSize = 0;
+	size_t m_count = 0;
+	std::vector<size_t> m_free;
+	std::mutex m_mutex;
+	std::condition_variable m_available;
+};
+}// namespace mdfs
+
+#endif
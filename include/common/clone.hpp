@@ -0,0 +1,29 @@
+#ifndef MDFS_CLONE_H
+#define MDFS_CLONE_H
+
+#include <common/io_engine.hpp>
+#include <cstdint>
+#include <string>
+
+namespace mdfs {
+// AUTO tries REFLINK, then EXTENTS, then BUFFERED, falling back whenever the file system doesn't support a method
+enum class CloneMethod { AUTO, REFLINK, EXTENTS, BUFFERED };
+const char *clone_method_name(CloneMethod method);
+
+struct CloneResult {
+	// the method that did the copy, BUFFERED if any extent needed it
+	CloneMethod method = CloneMethod::AUTO;
+	uint64_t extents = 0;
+	uint64_t dataBytes = 0;
+};
+
+// copies the image at src to a new file at dst, keeping holes as holes. REFLINK shares every block with FICLONE,
+// EXTENTS walks the data extents with SEEK_DATA/SEEK_HOLE and moves them with copy_file_range, and BUFFERED reads and
+// writes the data extents through BlockDevice, leaving out chunks that are all zeros. an existing dst is only
+// replaced with overwrite, and never when it is src itself. throws std::runtime_error, a partially written dst is
+// removed
+CloneResult clone_image(const std::string &src, const std::string &dst, CloneMethod method, bool overwrite,
+						const IoEngineOptions &io = IoEngineOptions());
+}// namespace mdfs
+
+#endif
@@ -8,6 +8,48 @@ typedef uint32_t crc32_t;
 
 namespace mdfs {
 crc32_t crc32(const void *data, size_t length, crc32_t init = 0xFFFFFFFF);
-}
+// CRC of A followed by B, given crc32() of both halves and the length of B. O(log lengthB)
+crc32_t crc32_combine(crc32_t crcA, crc32_t crcB, uint64_t lengthB);
+// crc32() of length zero bytes, without touching any memory. O(log length)
+crc32_t crc32_zeros(uint64_t length);
+// copies length bytes from src to dst and returns their crc32(), reading the source only once
+crc32_t copy_and_crc(void *dst, const void *src, size_t length, crc32_t init = 0xFFFFFFFF);
+// name of the kernel crc32() dispatches to on this CPU
+const char *crc32_implementation();
 
-#endif
\ No newline at end of file
+// running CRC for data that arrives in pieces, finalize() of the whole sequence matches crc32() of it in one go
+class Crc32 {
+public:
+	Crc32(crc32_t init = 0xFFFFFFFF) : m_state(init) {}
+
+	Crc32 &update(const void *data, size_t length);
+	// same as update() over length zero bytes, without touching any memory. O(log length)
+	Crc32 &update_zeros(uint64_t length);
+	// copies length bytes from src to dst and checksums them in the same pass
+	Crc32 &copy_and_update(void *dst, const void *src, size_t length);
+
+	crc32_t finalize() const { return ~m_state; }
+	void reset(crc32_t init = 0xFFFFFFFF) { m_state = init; }
+
+private:
+	crc32_t m_state;
+};
+
+// raw kernels working on the running CRC register, without the final inversion applied by crc32()
+namespace crc32_kernels {
+uint32_t bytewise(uint32_t crc, const uint8_t *data, size_t length);
+uint32_t slice16(uint32_t crc, const uint8_t *data, size_t length);
+// the copy_ kernels also store the input to dst, which must not overlap it
+uint32_t copy_slice16(uint32_t crc, uint8_t *dst, const uint8_t *src, size_t length);
+#if defined(__x86_64__) || defined(__i386__)
+// carry-less multiplication folding, the caller has to check the CPU supports PCLMULQDQ and SSE4.1, or
+// VPCLMULQDQ and AVX-512 respectively
+uint32_t pclmul(uint32_t crc, const uint8_t *data, size_t length);
+uint32_t vpclmul(uint32_t crc, const uint8_t *data, size_t length);
+uint32_t copy_pclmul(uint32_t crc, uint8_t *dst, const uint8_t *src, size_t length);
+uint32_t copy_vpclmul(uint32_t crc, uint8_t *dst, const uint8_t *src, size_t length);
+#endif
+}// namespace crc32_kernels
+}// namespace mdfs
+
+#endif
@@ -0,0 +1,39 @@
+#ifndef MDFS_EXTENT_MAP_H
+#define MDFS_EXTENT_MAP_H
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace mdfs {
+// [offset, end) byte range of a file that holds data
+struct DataExtent {
+	uint64_t offset;
+	uint64_t end;
+};
+
+// the next data extent at or after offset found with SEEK_DATA/SEEK_HOLE, clamped to size. nullopt past the last
+// one. file systems without SEEK_DATA report the rest of the file as data. throws std::runtime_error
+std::optional<DataExtent> next_data_extent(int fd, uint64_t offset, uint64_t size);
+
+// every data extent of a file, so ranges can be checked for holes in O(log n) without asking the kernel again
+class ExtentMap {
+public:
+	ExtentMap() {}
+	ExtentMap(int fd, uint64_t size);
+	// throws std::runtime_error if the file can't be opened
+	ExtentMap(const std::string &path);
+
+	uint64_t size() const { return m_size; }
+	const std::vector<DataExtent> &extents() const { return m_extents; }
+	// no byte of [offset, offset + length) holds data, ranges past the end of the file are holes as well
+	bool is_hole(uint64_t offset, uint64_t length) const;
+
+private:
+	uint64_t m_size = 0;
+	std::vector<DataExtent> m_extents;
+};
+}// namespace mdfs
+
+#endif
@@ -0,0 +1,68 @@
+#ifndef MDFS_FREE_SPACE_H
+#define MDFS_FREE_SPACE_H
+
+#include <array>
+#include <common/result.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <set>
+#include <utility>
+#include <vector>
+
+namespace mdfs {
+enum class Fit { FIRST, BEST };
+
+// free sectors of a disk as coalesced, inclusive [first, last] extents. extents are indexed by start, by length for
+// best fit, and by start within power of two length classes for first fit. reserve, release and extent_at are
+// O(log n) in the number of extents. a first fit takes the lowest start of every class that always fits in O(log n),
+// but walks the classes from the one of sizeInLBA up to there by start, below the answer. that is linear in those
+// extents in the worst case, like many holes just too short for the request or too short once aligned. best fit
+// likewise walks the extents that are long enough but lose the fit to alignment
+class FreeSpaceMap {
+public:
+	struct Extent {
+		uint64_t first;
+		uint64_t last;
+		uint64_t size() const { return last - first + 1; }
+	};
+
+	FreeSpaceMap() {}
+	// everything from first to last is free
+	FreeSpaceMap(uint64_t first, uint64_t last) { release(first, last); }
+
+	// marks [first, last] as used, FAILURE without changing anything if part of it isn't free
+	Result reserve(uint64_t first, uint64_t last);
+	// marks [first, last] as free, merging it with the neighbouring extents. the range must not be free already, an
+	// empty range with first past last is ignored
+	void release(uint64_t first, uint64_t last);
+
+	// first LBA of sizeInLBA free sectors starting on a multiple of alignment. FIRST takes the lowest such LBA, BEST
+	// the one in the smallest extent that fits
+	std::optional<uint64_t> find(uint64_t sizeInLBA, uint64_t alignment, Fit fit) const;
+	// the free extent containing LBA, if it is free
+	std::optional<Extent> extent_at(uint64_t LBA) const;
+	// the largest run of sectors starting on a multiple of alignment
+	std::optional<Extent> largest(uint64_t alignment) const;
+
+	std::vector<Extent> extents() const;
+	bool empty() const { return m_byStart.empty(); }
+
+private:
+	static size_t size_class(uint64_t size) { return 63 - __builtin_clzll(size); }
+	static uint64_t aligned_start(const Extent &extent, uint64_t alignment);
+	static bool fits(const Extent &extent, uint64_t sizeInLBA, uint64_t alignment);
+	void insert(uint64_t first, uint64_t last);
+	void erase(std::map<uint64_t, uint64_t>::iterator it);
+
+	// start -> last
+	std::map<uint64_t, uint64_t> m_byStart;
+	// (size, start)
+	std::set<std::pair<uint64_t, uint64_t>> m_bySize;
+	// start -> last of the extents with a size in [2^n, 2^(n + 1))
+	std::array<std::map<uint64_t, uint64_t>, 64> m_byClass;
+};
+}// namespace mdfs
+
+#endif
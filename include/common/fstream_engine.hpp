@@ -0,0 +1,41 @@
+#ifndef MDFS_FSTREAM_ENGINE_H
+#define MDFS_FSTREAM_ENGINE_H
+
+#include <common/io_engine.hpp>
+#include <fstream>
+
+namespace mdfs {
+// synchronous engine on top of std::fstream. kernel offloaded zeroing goes through a second descriptor
+class FstreamEngine : public IoEngine {
+public:
+	FstreamEngine() {}
+	FstreamEngine(const IoEngineOptions &options) : m_direct(options.direct) {}
+	~FstreamEngine() { close(); }
+
+	void open(const std::string &path, size_t blockSize, std::ios_base::openmode openmode) override;
+	void close() override;
+	bool is_open() const override { return m_file.is_open(); }
+
+	void read_lba(size_t LBA, char *data, size_t sizeInLBA) override;
+	void write_lba(size_t LBA, const char *data, size_t sizeInLBA) override;
+	void zero_lba(size_t LBA, size_t sizeInLBA) override;
+	void flush() override { m_file.flush(); }
+	// flushes the stream and syncs the file through the second descriptor
+	void sync_lba(size_t LBA, size_t sizeInLBA) override;
+	size_t size_b() override { return m_fileSize; }
+
+	const char *name() const override { return "fstream"; }
+
+	static std::unique_ptr<IoEngine> create(const IoEngineOptions &options);
+
+private:
+	std::string m_path;
+	std::fstream m_file;
+	int m_fd = -1;
+	size_t m_fileSize = 0;
+	bool m_writable = false;
+	bool m_direct = false;
+};
+}// namespace mdfs
+
+#endif
@@ -13,6 +13,8 @@
 	GUID({0xC12A7328, 0xF81F, 0x11D2, {0xBA, 0x4B, 0x00, 0xA0, 0xC9, 0x3E, 0xC9, 0x3B}})
 #define GPT_PARTITION_CONTAINING_LEGACY_MBR_GUID                                                                       \
 	GUID({0x024DEE41, 0x33E7, 0x11D3, {0x9D, 0x69, 0x00, 0x08, 0xC7, 0x81, 0xF3, 0x9F}})
+#define GPT_LINUX_FILESYSTEM_DATA_GUID                                                                                 \
+	GUID({0x0FC63DAF, 0x8483, 0x4772, {0x8E, 0x79, 0x3D, 0x69, 0xD8, 0x47, 0x7D, 0xE4}})
 
 #define GPT_REVISION_01 0x00010000
 #define GPT_SIGNATURE 0x5452415020494645
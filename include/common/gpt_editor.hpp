@@ -0,0 +1,76 @@
+#ifndef MDFS_GPT_EDITOR_H
+#define MDFS_GPT_EDITOR_H
+
+#include <common/block_device.hpp>
+#include <common/gpt.hpp>
+#include <common/result.hpp>
+#include <common/table_reader.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+namespace mdfs {
+// in memory copy of a GPT that tracks which sectors of the entry array were modified. the array CRC is kept as one
+// CRC per sector and merged with crc32_combine, so an edit only re-checksums the sectors it touched, and commit()
+// only writes those sectors plus the headers. the block size of the device has to be the one of the table
+class GptEditor {
+public:
+	GptEditor(BlockDevice &disk) : m_disk(disk) {}
+
+	// FAILURE if neither copy of the GPT is valid. a copy that is invalid, or differs from the primary, is rewritten
+	// in full on the next commit
+	Result load();
+
+	// the primary header, with the CRCs as of the last load or commit
+	const HeaderGPT &header() const { return header_of(m_primaryHeader); }
+	uint32_t entry_count() const { return header().numberOfPartitionEntries; }
+	const PartitionEntryGPT &entry(uint32_t index) const { return entries().at(index); }
+	GptEntryRange entries() const {
+		return GptEntryRange(std::span<const std::byte>(m_entries.data(), m_entryBytes), entry_count(),
+							 header().sizeOfPartitionEntries);
+	}
+
+	void set_entry(uint32_t index, const PartitionEntryGPT &entry);
+	void clear_entry(uint32_t index);
+	void set_disk_guid(const GUID &guid);
+
+	bool dirty() const { return m_headersDirty || m_dirtySectors != 0; }
+	size_t dirty_sectors() const { return m_dirtySectors; }
+
+	// recomputes the CRCs and writes the changes. the backup entries and header go first and are synced before the
+	// primary ones, so after a crash at any point at least one copy is complete and valid. NO_WORK if nothing changed
+	Result commit();
+
+private:
+	static HeaderGPT &header_of(std::vector<std::byte> &sector) {
+		return *reinterpret_cast<HeaderGPT *>(sector.data());
+	}
+	static const HeaderGPT &header_of(const std::vector<std::byte> &sector) {
+		return *reinterpret_cast<const HeaderGPT *>(sector.data());
+	}
+	size_t entry_sectors() const { return m_sectorCRCs.size(); }
+	void mark_dirty(uint64_t offset, size_t length);
+	crc32_t sector_crc(size_t sector) const;
+	void finish_header(std::vector<std::byte> &sector, crc32_t entriesCRC);
+	void write_copy(const std::vector<std::byte> &headerSector, bool all);
+
+	BlockDevice &m_disk;
+	std::vector<std::byte> m_primaryHeader;
+	std::vector<std::byte> m_backupHeader;
+	// the entry array padded to whole sectors
+	std::vector<std::byte> m_entries;
+	size_t m_entryBytes = 0;
+	std::vector<crc32_t> m_sectorCRCs;
+	std::vector<uint8_t> m_dirty;
+	size_t m_dirtySectors = 0;
+	bool m_headersDirty = false;
+	bool m_rewritePrimary = false;
+	bool m_rewriteBackup = false;
+};
+
+// stores a UTF-8 name as the UTF-16 partition name, FAILURE if it isn't valid UTF-8 or takes more than 36 code units
+Result set_gpt_partition_name(PartitionEntryGPT &entry, std::string_view name);
+}// namespace mdfs
+
+#endif
@@ -1,8 +1,13 @@
 #ifndef MDFS_GUID_H
 #define MDFS_GUID_H
 
+#include <array>
+#include <common/result.hpp>
+#include <cstddef>
 #include <cstdint>
+#include <span>
 #include <string>
+#include <string_view>
 
 #define UUIDv4 static_cast<uint16_t>(0x4000)
 #define UUID_RFC4122 static_cast<uint8_t>(0x80)
@@ -10,6 +15,11 @@
 #define UUID_VERSION_MASK static_cast<uint16_t>(~0xF000)
 #define UUID_VARIANT_MASK static_cast<uint8_t>(~0xC0)
 
+// xxxxxxxx-xxxx-xxxx-xxxx-xxxxxxxxxxxx, without a terminator
+#define UUID_STRING_LENGTH 36
+
+#define UUID_ENTROPY_POOL_SIZE 4096
+
 #define UUID_NULL GUID({0x00000000, 0x0000, 0x0000, {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00}})
 
 struct GUID {
@@ -19,7 +29,62 @@ struct GUID {
 	uint8_t d4[8];
 } __attribute__((packed));
 
-void gen_random_UUIDv4(GUID *uuid);
+// offset of the high nibble of every byte in the string form, d1 to d4 in order
+inline constexpr std::array<uint8_t, 16> UUID_BYTE_OFFSETS = {0,  2,  4,  6,  9,  11, 14, 16,
+																19, 21, 24, 26, 28, 30, 32, 34};
+
+// value of every hex digit, 0xFF for all other characters, so one OR over the decoded nibbles catches bad input
+inline constexpr std::array<uint8_t, 256> UUID_HEX_VALUES = [] {
+	std::array<uint8_t, 256> values = {};
+	values.fill(0xFF);
+	for (int i = 0; i < 10; i++) { values['0' + i] = uint8_t(i); }
+	for (int i = 0; i < 6; i++) {
+		values['a' + i] = uint8_t(10 + i);
+		values['A' + i] = uint8_t(10 + i);
+	}
+	return values;
+}();
+
+// parses the 36 character form, upper or lower case. uuid is left untouched if str isn't a valid GUID
+constexpr bool parse_uuid(std::string_view str, GUID *uuid) {
+	if (str.size() != UUID_STRING_LENGTH || str[8] != '-' || str[13] != '-' || str[18] != '-' || str[23] != '-') {
+		return false;
+	}
+	uint8_t bytes[16] = {};
+	uint8_t invalid = 0;
+	for (size_t i = 0; i < 16; i++) {
+		uint8_t high = UUID_HEX_VALUES[uint8_t(str[UUID_BYTE_OFFSETS[i]])];
+		uint8_t low = UUID_HEX_VALUES[uint8_t(str[UUID_BYTE_OFFSETS[i] + 1])];
+		invalid |= high | low;
+		bytes[i] = uint8_t((high << 4) | low);
+	}
+	if (invalid & 0xF0) { return false; }
+
+	uuid->d1 = (uint32_t(bytes[0]) << 24) | (uint32_t(bytes[1]) << 16) | (uint32_t(bytes[2]) << 8) | bytes[3];
+	uuid->d2 = uint16_t((bytes[4] << 8) | bytes[5]);
+	uuid->d3 = uint16_t((bytes[6] << 8) | bytes[7]);
+	for (size_t i = 0; i < 8; i++) { uuid->d4[i] = bytes[8 + i]; }
+	return true;
+}
+
+// writes the lower case 36 character form, no terminator is appended
+constexpr void format_uuid(const GUID &uuid, std::span<char, UUID_STRING_LENGTH> out) {
+	constexpr char digits[] = "0123456789abcdef";
+	uint8_t bytes[16] = {uint8_t(uuid.d1 >> 24), uint8_t(uuid.d1 >> 16), uint8_t(uuid.d1 >> 8), uint8_t(uuid.d1),
+						 uint8_t(uuid.d2 >> 8),  uint8_t(uuid.d2),		 uint8_t(uuid.d3 >> 8), uint8_t(uuid.d3)};
+	for (size_t i = 0; i < 8; i++) { bytes[8 + i] = uuid.d4[i]; }
+	out[8] = out[13] = out[18] = out[23] = '-';
+	for (size_t i = 0; i < 16; i++) {
+		out[UUID_BYTE_OFFSETS[i]] = digits[bytes[i] >> 4];
+		out[UUID_BYTE_OFFSETS[i] + 1] = digits[bytes[i] & 0x0F];
+	}
+}
+
+// random version 4 GUIDs. entropy comes from getrandom() in blocks of UUID_ENTROPY_POOL_SIZE bytes kept per thread,
+// so bulk generation costs one syscall per 256 GUIDs and threads never contend. returns FAILURE if the kernel
+// can't supply entropy. the output is left untouched then, none of several GUIDs are written if any fail
+mdfs::Result gen_random_UUIDv4(GUID *uuid);
+mdfs::Result gen_random_UUIDv4(GUID *uuids, size_t count);
 void print_uuid(const GUID &uuid);
 bool get_uuid_from_string(const std::string &str, GUID *uuid);
 #endif
\ No newline at end of file
@@ -0,0 +1,104 @@
+#ifndef MDFS_IO_ENGINE_H
+#define MDFS_IO_ENGINE_H
+
+#include <common/crc32.hpp>
+#include <common/result.hpp>
+#include <common/units.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <ios>
+#include <memory>
+#include <span>
+#include <string>
+#include <vector>
+
+#define MDFS_DEFAULT_IO_ENGINE "posix"
+
+namespace mdfs {
+enum class AccessPattern { NORMAL, SEQUENTIAL, RANDOM, WILL_NEED, DONT_NEED };
+
+struct IoEngineOptions {
+	std::string engine = MDFS_DEFAULT_IO_ENGINE;
+	// requests kept in flight and the size of a single request, used by asynchronous engines
+	size_t queueDepth = 32;
+	size_t requestSize = 1 * mdfs::units::mb;
+	// bypass the page cache with O_DIRECT, only supported by engines working on file descriptors
+	bool direct = false;
+	// invoked with the total number of bytes completed so far, as completions arrive
+	std::function<void(uint64_t)> progress;
+};
+
+struct IoExtent {
+	size_t LBA;
+	const char *data;
+	size_t sizeInLBA;
+};
+
+// backend used by BlockDevice. all transfers address absolute LBAs, engines keep no cursor of their own
+class IoEngine {
+public:
+	virtual ~IoEngine() {}
+
+	// throws std::runtime_error if the image can't be opened
+	virtual void open(const std::string &path, size_t blockSize, std::ios_base::openmode openmode) = 0;
+	virtual void close() = 0;
+	virtual bool is_open() const = 0;
+
+	virtual void read_lba(size_t LBA, char *data, size_t sizeInLBA) = 0;
+	virtual void write_lba(size_t LBA, const char *data, size_t sizeInLBA) = 0;
+	// writes the sectors and feeds them into crc. engines that copy the data on its way to the image override this
+	// to checksum it in the same pass
+	virtual void write_lba_crc(size_t LBA, const char *data, size_t sizeInLBA, Crc32 &crc) {
+		crc.update(data, mdfs::lba_to_addr(sizeInLBA, m_blockSize));
+		write_lba(LBA, data, sizeInLBA);
+	}
+	// extents are sorted by LBA and don't overlap. engines able to submit several extents at once override this
+	virtual void write_batch(std::span<const IoExtent> extents) {
+		for (const IoExtent &extent : extents) { write_lba(extent.LBA, extent.data, extent.sizeInLBA); }
+	}
+	// zeroes the range by streaming zeros through write_lba, engines override it if they can do better
+	virtual void zero_lba(size_t LBA, size_t sizeInLBA);
+	virtual void flush() = 0;
+	// size of the underlying image in bytes
+	virtual size_t size_b() = 0;
+
+	virtual const char *name() const = 0;
+	// true if transfers may be issued from several threads at once
+	virtual bool thread_safe() const { return false; }
+
+	// engines backed by a memory mapping return views straight into it, everything else returns an empty span
+	virtual std::span<std::byte> map_lba(size_t /*LBA*/, size_t /*sizeInLBA*/) { return {}; }
+	// waits until everything written to the range is durable. mapped engines write the range back, engines on file
+	// descriptors sync the whole file. a no-op unless overridden
+	virtual void sync_lba(size_t /*LBA*/, size_t /*sizeInLBA*/) {}
+	// hints how a range, or the whole image if sizeInLBA is 0, is going to be accessed
+	virtual void advise(AccessPattern /*pattern*/, size_t /*LBA*/ = 0, size_t /*sizeInLBA*/ = 0) {}
+
+	size_t block_size() const { return m_blockSize; }
+	void set_block_size(size_t newSize) { m_blockSize = newSize; }
+
+protected:
+	static constexpr size_t zero_buffer_size = 1 * mdfs::units::mb;
+
+	size_t m_blockSize = 512;
+	std::unique_ptr<char[]> m_zeroBuffer;
+	size_t m_zeroBufferSize = 0;
+};
+
+typedef std::unique_ptr<IoEngine> (*IoEngineFactory)(const IoEngineOptions &options);
+
+// registers a new engine, or replaces the factory of an existing one
+void register_io_engine(const std::string &name, IoEngineFactory factory);
+// throws std::runtime_error if no engine with the requested name is registered
+std::unique_ptr<IoEngine> make_io_engine(const IoEngineOptions &options);
+std::vector<std::string> io_engine_names();
+
+// asks the kernel to zero a byte range of an open file or block device without transferring the zeros.
+// returns NO_WORK if neither the file system nor the device supports it
+Result zero_range_native(int fd, uint64_t offset, uint64_t length);
+// offset, length and memory alignment O_DIRECT transfers on the descriptor have to respect
+size_t direct_io_alignment(int fd);
+}// namespace mdfs
+
+#endif
@@ -0,0 +1,45 @@
+#ifndef MDFS_MMAP_ENGINE_H
+#define MDFS_MMAP_ENGINE_H
+
+#include <common/io_engine.hpp>
+
+namespace mdfs {
+// maps the whole image into memory. transfers are plain copies, and map_lba hands out views into the mapping so
+// sectors can be inspected and edited in place without any intermediate buffer
+class MmapEngine : public IoEngine {
+public:
+	MmapEngine() {}
+	~MmapEngine() { close(); }
+
+	void open(const std::string &path, size_t blockSize, std::ios_base::openmode openmode) override;
+	void close() override;
+	bool is_open() const override { return m_fd >= 0; }
+
+	void read_lba(size_t LBA, char *data, size_t sizeInLBA) override;
+	void write_lba(size_t LBA, const char *data, size_t sizeInLBA) override;
+	void write_lba_crc(size_t LBA, const char *data, size_t sizeInLBA, Crc32 &crc) override;
+	void zero_lba(size_t LBA, size_t sizeInLBA) override;
+	void flush() override {}
+	size_t size_b() override { return m_fileSize; }
+
+	const char *name() const override { return "mmap"; }
+	bool thread_safe() const override { return true; }
+
+	std::span<std::byte> map_lba(size_t LBA, size_t sizeInLBA) override;
+	void sync_lba(size_t LBA, size_t sizeInLBA) override;
+	void advise(AccessPattern pattern, size_t LBA = 0, size_t sizeInLBA = 0) override;
+
+	static std::unique_ptr<IoEngine> create(const IoEngineOptions &options);
+
+private:
+	// page aligned byte range covering the LBAs, clamped to the mapping
+	std::span<std::byte> page_range(size_t LBA, size_t sizeInLBA);
+
+	int m_fd = -1;
+	std::byte *m_map = nullptr;
+	size_t m_fileSize = 0;
+	bool m_writable = false;
+};
+}// namespace mdfs
+
+#endif
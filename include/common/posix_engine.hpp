@@ -0,0 +1,66 @@
+#ifndef MDFS_POSIX_ENGINE_H
+#define MDFS_POSIX_ENGINE_H
+
+#include <atomic>
+#include <common/buffer_pool.hpp>
+#include <common/io_engine.hpp>
+#include <sys/uio.h>
+#include <vector>
+
+namespace mdfs {
+// synchronous engine on top of pread/pwrite. there is no shared cursor, so any number of threads can transfer at
+// once. with direct I/O enabled the image is opened with O_DIRECT and every transfer is bounced through a pool of
+// buffers aligned to the device, edges that don't line up with the required alignment are handled with
+// read-modify-write of the containing block. concurrent unaligned writes into the same block are not ordered
+class PosixEngine : public IoEngine {
+public:
+	PosixEngine(const IoEngineOptions &options);
+	~PosixEngine() { close(); }
+
+	void open(const std::string &path, size_t blockSize, std::ios_base::openmode openmode) override;
+	void close() override;
+	bool is_open() const override { return m_fd >= 0; }
+
+	void read_lba(size_t LBA, char *data, size_t sizeInLBA) override;
+	void write_lba(size_t LBA, const char *data, size_t sizeInLBA) override;
+	// the checksum is taken while the data is copied into a bounce buffer when there is one
+	void write_lba_crc(size_t LBA, const char *data, size_t sizeInLBA, Crc32 &crc) override;
+	// adjacent extents are written with a single pwritev
+	void write_batch(std::span<const IoExtent> extents) override;
+	void zero_lba(size_t LBA, size_t sizeInLBA) override;
+	void flush() override {}
+	void sync_lba(size_t LBA, size_t sizeInLBA) override;
+	size_t size_b() override { return m_fileSize; }
+
+	const char *name() const override { return "posix"; }
+	bool thread_safe() const override { return true; }
+	// alignment offsets and lengths are rounded to, 1 unless direct I/O is enabled
+	size_t alignment() const { return m_alignment; }
+
+	static std::unique_ptr<IoEngine> create(const IoEngineOptions &options);
+
+protected:
+	enum class Op { READ, WRITE, ZERO };
+
+	// writes feed every byte of data into crc in order, if one is given
+	void transfer(Op op, uint64_t offset, char *data, size_t length, Crc32 *crc = nullptr);
+	void transfer_edge(Op op, uint64_t offset, char *data, size_t length, Crc32 *crc = nullptr);
+	virtual void transfer_aligned(Op op, uint64_t offset, char *data, size_t length, Crc32 *crc = nullptr);
+	// writes the iovecs back to back starting at offset, skipping the first skip bytes
+	void pwritev_all(uint64_t offset, std::vector<iovec> iov, size_t skip = 0);
+	void report(size_t bytes);
+
+	IoEngineOptions m_options;
+	int m_fd = -1;
+	size_t m_fileSize = 0;
+	size_t m_alignment = 1;
+	size_t m_bufferAlignment = 4 * mdfs::units::kb;
+	std::atomic<uint64_t> m_completedBytes = 0;
+
+	// bounce buffers for direct I/O and unaligned edges, and one read only buffer of zeros
+	AlignedBufferPool m_pool;
+	AlignedBufferPool m_zeros;
+};
+}// namespace mdfs
+
+#endif
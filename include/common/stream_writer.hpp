@@ -0,0 +1,46 @@
+#ifndef MDFS_STREAM_WRITER_H
+#define MDFS_STREAM_WRITER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace mdfs {
+// strictly sequential writer for a file descriptor that may be a pipe, it never seeks back. zeros become holes on an
+// empty regular file and are spliced from a shared zero buffer into pipes, file contents are spliced into pipes and
+// copied with copy_file_range into files, so neither passes through user space when the kernel allows it. anything
+// else goes through write() in chunks of at most chunkSize, which also bounds the memory used for copies
+class StreamWriter {
+public:
+	StreamWriter(int fd, size_t chunkSize = 1048576);
+
+	void write(const void *data, size_t size);
+	void write_zeros(uint64_t size);
+	// size bytes of the file behind fd, starting at offset
+	void write_file(int fd, uint64_t offset, uint64_t size);
+	// extends a regular file over trailing holes, the stream is complete afterwards
+	void finish();
+
+	uint64_t offset() const { return m_offset; }
+
+private:
+	void write_fully(const void *data, size_t size);
+	void flush_hole();
+	size_t splice_zeros(size_t size);
+
+	int m_fd;
+	size_t m_chunkSize;
+	bool m_pipe = false;
+	bool m_holes = false;
+	bool m_useSplice = true;
+	bool m_useCopyRange = true;
+	// position of the descriptor when the stream started, only tracked for files that get holes
+	uint64_t m_start = 0;
+	uint64_t m_offset = 0;
+	// zeros skipped but not yet seeked over
+	uint64_t m_pendingHole = 0;
+	std::vector<char> m_buffer;
+};
+}// namespace mdfs
+
+#endif
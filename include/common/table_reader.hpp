@@ -0,0 +1,116 @@
+#ifndef MDFS_TABLE_READER_H
+#define MDFS_TABLE_READER_H
+
+#include <common/block_device.hpp>
+#include <common/gpt.hpp>
+#include <common/mbr.hpp>
+#include <common/result.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace mdfs {
+// outcome of reading one copy of the GPT, in the order the checks are made
+enum class GptStatus { VALID, OUT_OF_RANGE, BAD_SIGNATURE, BAD_HEADER, BAD_HEADER_CRC, BAD_ENTRIES, BAD_ENTRIES_CRC };
+const char *gpt_status_name(GptStatus status);
+
+// partitions of a GPT entry array whose type GUID isn't the unused one, entries are sizeOfPartitionEntries apart
+class GptEntryRange {
+public:
+	struct Entry {
+		uint32_t index;
+		const PartitionEntryGPT *entry;
+	};
+
+	class Iterator {
+	public:
+		Iterator(const GptEntryRange *range, uint32_t index) : m_range(range), m_index(range->next_used(index)) {}
+		Entry operator*() const { return {m_index, &m_range->at(m_index)}; }
+		Iterator &operator++() {
+			m_index = m_range->next_used(m_index + 1);
+			return *this;
+		}
+		bool operator!=(const Iterator &other) const { return m_index != other.m_index; }
+
+	private:
+		const GptEntryRange *m_range;
+		uint32_t m_index;
+	};
+
+	GptEntryRange() {}
+	GptEntryRange(std::span<const std::byte> entries, uint32_t count, uint32_t stride)
+		: m_entries(entries), m_count(count), m_stride(stride) {}
+
+	Iterator begin() const { return Iterator(this, 0); }
+	Iterator end() const { return Iterator(this, m_count); }
+	// every slot, used or not
+	const PartitionEntryGPT &at(uint32_t index) const {
+		return *reinterpret_cast<const PartitionEntryGPT *>(m_entries.data() + size_t(index) * m_stride);
+	}
+	uint32_t count() const { return m_count; }
+
+private:
+	uint32_t next_used(uint32_t index) const;
+
+	std::span<const std::byte> m_entries;
+	uint32_t m_count = 0;
+	uint32_t m_stride = sizeof(PartitionEntryGPT);
+};
+
+// one copy of the GPT. header and entries point into the image mapping when the engine can map sectors, and into
+// buffers owned by the reader otherwise
+struct GptCopy {
+	GptStatus status = GptStatus::OUT_OF_RANGE;
+	size_t headerLBA = 0;
+	const HeaderGPT *header = nullptr;
+	std::span<const std::byte> entries;
+
+	bool valid() const { return status == GptStatus::VALID; }
+	// empty unless the copy is valid
+	GptEntryRange used_entries() const;
+};
+
+// reads and validates the MBR and both GPT copies of an image. the backup is looked for where the primary says it
+// is, or in the last sector if the primary is unusable
+class PartitionTableReader {
+public:
+	PartitionTableReader(BlockDevice &disk) : m_disk(disk) {}
+
+	// FAILURE if the image is too small to hold an MBR, an image without a GPT still reads successfully
+	Result read();
+	// read() with 512 byte sectors, then 4096 byte ones if no primary GPT turned up. the device is left at the
+	// sector size the tables were read with
+	Result read_detecting_sector_size();
+
+	const mbr::MBR &mbr() const { return m_mbr; }
+	bool has_mbr_signature() const { return m_mbr.signature[0] == 0x55 && m_mbr.signature[1] == 0xAA; }
+	// a single 0xEE record, as written by build_protective_mbr
+	bool has_protective_mbr() const;
+
+	const GptCopy &primary() const { return m_primary; }
+	const GptCopy &backup() const { return m_backup; }
+	// the copy the firmware would use, primary first. nullptr if neither is valid
+	const GptCopy *active() const;
+
+private:
+	void read_copy(size_t LBA, GptCopy &copy, std::vector<std::byte> &headerBuffer,
+				   std::vector<std::byte> &entryBuffer);
+	std::span<const std::byte> load(size_t LBA, size_t sizeInLBA, std::vector<std::byte> &buffer);
+
+	BlockDevice &m_disk;
+	mbr::MBR m_mbr = {};
+	GptCopy m_primary;
+	GptCopy m_backup;
+	std::vector<std::byte> m_primaryHeader;
+	std::vector<std::byte> m_primaryEntries;
+	std::vector<std::byte> m_backupHeader;
+	std::vector<std::byte> m_backupEntries;
+};
+
+// partition name as UTF-8, up to the first NUL
+std::string gpt_partition_name(const PartitionEntryGPT &entry);
+}// namespace mdfs
+
+#endif
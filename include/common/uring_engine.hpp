@@ -0,0 +1,68 @@
+#ifndef MDFS_URING_ENGINE_H
+#define MDFS_URING_ENGINE_H
+
+#include <common/buffer_pool.hpp>
+#include <common/posix_engine.hpp>
+#include <linux/io_uring.h>
+
+namespace mdfs {
+// asynchronous engine on top of raw io_uring syscalls. every transfer is split into requestSize chunks with up to
+// queueDepth of them in flight, each one owning a registered buffer. if the ring can't be set up (old kernels,
+// seccomp filtered sandboxes) the engine falls back to the synchronous pread/pwrite path of PosixEngine on the same
+// descriptor, which also provides the direct I/O alignment handling. a ring has a single submitter, so unlike its
+// base the engine is not thread safe
+class UringEngine : public PosixEngine {
+public:
+	UringEngine(const IoEngineOptions &options) : PosixEngine(options) {}
+	~UringEngine() { close(); }
+
+	void open(const std::string &path, size_t blockSize, std::ios_base::openmode openmode) override;
+	void close() override;
+
+	const char *name() const override { return "io_uring"; }
+	bool thread_safe() const override { return false; }
+	// submits every run of adjacent extents as one WRITEV, all of them with a single io_uring_enter
+	void write_batch(std::span<const IoExtent> extents) override;
+	// false if the engine fell back to synchronous I/O
+	bool async() const { return m_ringFd >= 0; }
+
+	static std::unique_ptr<IoEngine> create(const IoEngineOptions &options);
+
+protected:
+	void transfer_aligned(Op op, uint64_t offset, char *data, size_t length, Crc32 *crc = nullptr) override;
+
+private:
+	struct Slot {
+		bool busy = false;
+		uint64_t offset;
+		size_t length;
+		size_t done;
+		char *user;
+	};
+
+	bool setup_ring();
+	void teardown_ring();
+	void queue_slot(Op op, unsigned index);
+	io_uring_sqe *next_sqe(unsigned tail);
+	void commit_sqe(unsigned tail);
+
+	int m_ringFd = -1;
+	void *m_sqRing = nullptr;
+	void *m_cqRing = nullptr;
+	size_t m_sqRingSize = 0;
+	size_t m_cqRingSize = 0;
+	io_uring_sqe *m_sqes = nullptr;
+	size_t m_sqesSize = 0;
+	unsigned *m_sqHead, *m_sqTail, *m_sqMask, *m_sqArray;
+	unsigned *m_cqHead, *m_cqTail, *m_cqMask;
+	io_uring_cqe *m_cqes;
+	unsigned m_pending = 0;
+	bool m_fixedBuffers = false;
+
+	// one request buffer per slot, registered with the ring together with the zero buffer of the base
+	AlignedBufferPool m_slotBuffers;
+	std::vector<Slot> m_slots;
+};
+}// namespace mdfs
+
+#endif
@@ -0,0 +1,14 @@
+#ifndef MDFS_UTIL_H
+#define MDFS_UTIL_H
+
+#include <cstddef>
+#include <string>
+
+namespace mdfs {
+// throws std::runtime_error with what followed by the description of errno
+[[noreturn]] void throw_errno(const std::string &what);
+// true if every one of the size bytes at data is zero, compares the buffer against itself shifted by one byte
+bool all_zeros(const void *data, size_t size);
+}// namespace mdfs
+
+#endif
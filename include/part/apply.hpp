@@ -0,0 +1,26 @@
+#ifndef MDFS_PART_APPLY_H
+#define MDFS_PART_APPLY_H
+
+#include <common/CLI11.hpp>
+#include <common/io_engine.hpp>
+#include <ostream>
+#include <part/layout.hpp>
+#include <string>
+#include <vector>
+
+namespace mdfs {
+struct ApplyInfo {
+	std::string layoutFile;
+	std::vector<std::string> images;
+	mdfs::IoEngineOptions io;
+};
+
+CLI::App *make_apply_app(mdfs::ApplyInfo &info, CLI::App &app);
+int do_apply(mdfs::ApplyInfo &info, const CLI::App *app);
+// writes the tables of a layout to an existing image and prints where the partitions went to out. errors are printed
+// to stderr, false if the layout couldn't be applied
+bool apply_layout(const mdfs::Layout &layout, const std::string &path, const mdfs::IoEngineOptions &io, bool dryRun,
+				  std::ostream &out);
+}// namespace mdfs
+
+#endif
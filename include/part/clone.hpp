@@ -0,0 +1,20 @@
+#ifndef MDFS_PART_CLONE_H
+#define MDFS_PART_CLONE_H
+
+#include <common/CLI11.hpp>
+#include <common/io_engine.hpp>
+#include <string>
+
+namespace mdfs {
+struct CloneInfo {
+	std::string source;
+	std::string destination;
+	std::string method = "auto";
+	mdfs::IoEngineOptions io;
+};
+
+CLI::App *make_clone_app(mdfs::CloneInfo &info, CLI::App &app);
+int do_clone(mdfs::CloneInfo &info, const CLI::App *app);
+}// namespace mdfs
+
+#endif
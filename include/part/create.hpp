@@ -0,0 +1,24 @@
+#ifndef MDFS_PART_CREATE_H
+#define MDFS_PART_CREATE_H
+
+#include <common/CLI11.hpp>
+#include <common/io_engine.hpp>
+#include <string>
+
+namespace mdfs {
+struct CreateInfo {
+	std::string outFile;
+	// size expression, see parse_size
+	std::string size;
+	// empty table to create right away, gpt or mbr, or a layout file to apply
+	std::string table;
+	std::string layoutFile;
+	size_t sectorSize = 512;
+	mdfs::IoEngineOptions io;
+};
+
+CLI::App *make_create_app(mdfs::CreateInfo &info, CLI::App &app);
+int do_create(mdfs::CreateInfo &info, const CLI::App *app);
+}// namespace mdfs
+
+#endif
@@ -0,0 +1,65 @@
+#ifndef MDFS_PART_DELTA_H
+#define MDFS_PART_DELTA_H
+
+#include <common/CLI11.hpp>
+#include <common/crc32.hpp>
+#include <common/io_engine.hpp>
+#include <cstdint>
+#include <string>
+
+namespace mdfs {
+// a delta is a DeltaHeader, one DeltaRecord per changed block in increasing block order, each DATA record followed
+// by the block's bytes, and an END record. the last block of an image may be shorter than blockSize
+#define DELTA_MAGIC "MDFSDLT"
+#define DELTA_VERSION 1
+
+struct DeltaHeader {
+	char magic[8] = DELTA_MAGIC;
+	uint32_t version = DELTA_VERSION;
+	uint32_t blockSize;
+	uint64_t baseSize;
+	uint64_t newSize;
+	// crc32 of the whole base image, checked before anything is patched
+	crc32_t baseCRC;
+	uint32_t reserved = 0;
+} __attribute__((packed));
+static_assert(sizeof(DeltaHeader) == 40);
+
+enum class DeltaKind : uint32_t { DATA = 1, ZERO = 2, END = 3 };
+
+struct DeltaRecord {
+	uint64_t block;
+	DeltaKind kind;
+	// crc32 of the block's bytes, or of the whole new image for END
+	crc32_t crc;
+} __attribute__((packed));
+static_assert(sizeof(DeltaRecord) == 16);
+
+struct DiffInfo {
+	std::string base;
+	std::string image;
+	// - writes to stdout
+	std::string output = "-";
+	std::string blockSize = "64K";
+	// 0 uses one thread per hardware thread
+	size_t jobs = 0;
+	mdfs::IoEngineOptions io = {.engine = "mmap", .progress = {}};
+};
+
+struct PatchInfo {
+	std::string base;
+	// - reads stdin
+	std::string delta = "-";
+	// empty patches base in place, otherwise base is cloned here first
+	std::string output;
+	size_t jobs = 0;
+	mdfs::IoEngineOptions io;
+};
+
+CLI::App *make_diff_app(mdfs::DiffInfo &info, CLI::App &app);
+int do_diff(mdfs::DiffInfo &info, const CLI::App *app);
+CLI::App *make_patch_app(mdfs::PatchInfo &info, CLI::App &app);
+int do_patch(mdfs::PatchInfo &info, const CLI::App *app);
+}// namespace mdfs
+
+#endif
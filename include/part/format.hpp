@@ -0,0 +1,27 @@
+#ifndef MDFS_PART_FORMAT_H
+#define MDFS_PART_FORMAT_H
+
+#include <common/guid.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace mdfs {
+// helpers shared by the subcommands parsing options and printing reports
+std::string guid_string(const GUID &uuid);
+// str quoted and escaped as a JSON string
+std::string json_string(const std::string &str);
+// bytes in the largest binary unit that keeps the value above 1, like 1.5 GiB
+std::string size_string(uint64_t bytes);
+// a size like 512, 64K, 1.5GiB or 2048s in bytes, using the binary mdfs::units. an s suffix counts sectors of
+// sectorSize bytes. nullopt if the expression can't be parsed or overflows
+std::optional<uint64_t> parse_size(std::string_view expression, size_t sectorSize);
+// a GPT partition type GUID, or one of the aliases linux and efi. nullopt for the unused type
+std::optional<GUID> parse_gpt_type(std::string_view type);
+// a non zero hexadecimal MBR OS type, with or without 0x
+std::optional<uint8_t> parse_mbr_type(std::string_view type);
+}// namespace mdfs
+
+#endif
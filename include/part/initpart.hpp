@@ -3,6 +3,7 @@
 
 #include <common/CLI11.hpp>
 #include <common/guid.hpp>
+#include <common/io_engine.hpp>
 #include <common/result.hpp>
 #include <cstdint>
 #include <string>
@@ -15,6 +16,7 @@ struct InitPartInfo {
 	std::string inFile = "none";
 	std::string type = "GPT";
 	size_t sectorSize = 512;
+	mdfs::IoEngineOptions io;
 
 	// GPT specific
 	size_t partitionEntryCount = 128;
@@ -30,6 +32,7 @@ struct InitpartRunInfo {
 	std::string inFile;
 	PartType type;
 	size_t sectorSize;
+	mdfs::IoEngineOptions io;
 
 	// GPT specific
 	size_t partitionEntryCount;
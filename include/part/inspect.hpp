@@ -0,0 +1,21 @@
+#ifndef MDFS_PART_INSPECT_H
+#define MDFS_PART_INSPECT_H
+
+#include <common/CLI11.hpp>
+#include <common/io_engine.hpp>
+#include <string>
+
+namespace mdfs {
+struct InspectInfo {
+	std::string inFile;
+	// 0 probes 512 and 4096 byte sectors for a GPT header
+	size_t sectorSize = 0;
+	std::string format = "text";
+	mdfs::IoEngineOptions io = {.engine = "mmap", .progress = {}};
+};
+
+CLI::App *make_inspect_app(mdfs::InspectInfo &info, CLI::App &app);
+int do_inspect(mdfs::InspectInfo &info, const CLI::App *app);
+}// namespace mdfs
+
+#endif
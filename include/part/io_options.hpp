@@ -0,0 +1,12 @@
+#ifndef MDFS_PART_IO_OPTIONS_H
+#define MDFS_PART_IO_OPTIONS_H
+
+#include <common/CLI11.hpp>
+#include <common/io_engine.hpp>
+
+namespace mdfs {
+// adds the options selecting and tuning the I/O engine to a subcommand
+void add_io_options(CLI::App *app, mdfs::IoEngineOptions &options);
+}// namespace mdfs
+
+#endif
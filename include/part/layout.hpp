@@ -0,0 +1,81 @@
+#ifndef MDFS_PART_LAYOUT_H
+#define MDFS_PART_LAYOUT_H
+
+#include <common/guid.hpp>
+#include <common/units.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <optional>
+#include <part/initpart.hpp>
+#include <string>
+#include <vector>
+
+namespace mdfs {
+struct LayoutPartition {
+	// nullopt takes whatever is left once every other partition is placed
+	std::optional<uint64_t> sizeInLBA;
+	// nullopt places the partition in the first aligned free space
+	std::optional<uint64_t> startingLBA;
+	// GPT type GUID, or the OS type in the first byte for MBR
+	GUID type;
+	uint8_t OSType = 0x83;
+	std::string name;
+	uint64_t attributes = 0;
+	// nullopt generates a random one
+	std::optional<GUID> guid;
+	bool bootable = false;
+	// file whose contents start the partition when the whole image is streamed, the rest of it is zeros
+	std::string source;
+};
+
+// a whole partition table as described by a layout file, one setting or partition per line:
+//
+//   # comment
+//   table gpt                  gpt or mbr
+//   sector-size 512
+//   disk-guid random           GPT only, a GUID or random
+//   entries 128                GPT only
+//   disk-signature random      MBR only, a hexadecimal number or random
+//   align 1M
+//   partition size=512M type=efi name="EFI system" attributes=0x1
+//   partition type=linux name=root
+//
+// partitions take the keys size, start, type, name, attributes, guid, source and, for MBR, the bootable flag
+struct Layout {
+	PartType type = PartType::GPT;
+	size_t sectorSize = 512;
+	std::optional<GUID> diskGUID;
+	uint32_t entryCount = 128;
+	std::optional<uint32_t> diskSignature;
+	uint64_t alignment = units::mb;
+	std::vector<LayoutPartition> partitions;
+};
+
+struct PlacedPartition {
+	uint32_t index;
+	uint64_t firstLBA;
+	uint64_t lastLBA;
+};
+
+// the sectors of a layout applied to an image of a given size, built in memory with every CRC filled in
+struct LayoutTables {
+	// LBA 0 up to the first usable LBA: the MBR and, for GPT, the primary header and entry array
+	std::vector<std::byte> primary;
+	// the backup entry array and header, which run up to the last LBA. empty for MBR, where backupLBA is the LBA
+	// past the end of the image
+	std::vector<std::byte> backup;
+	uint64_t backupLBA = 0;
+	std::vector<PlacedPartition> partitions;
+};
+
+// throws std::runtime_error naming the offending line
+Layout parse_layout(std::istream &in);
+// parse_layout on a file, - reads stdin
+Layout read_layout_file(const std::string &path);
+// places the partitions and builds the tables for an image of sizeInLBA sectors, throws std::runtime_error if the
+// partitions don't fit
+LayoutTables build_layout(const Layout &layout, uint64_t sizeInLBA);
+}// namespace mdfs
+
+#endif
@@ -0,0 +1,33 @@
+#ifndef MDFS_PART_PART_H
+#define MDFS_PART_PART_H
+
+#include <common/CLI11.hpp>
+#include <common/io_engine.hpp>
+#include <cstdint>
+#include <string>
+
+namespace mdfs {
+struct PartInfo {
+	std::string inFile;
+	// 0 probes 512 and 4096 byte sectors for a GPT header
+	size_t sectorSize = 0;
+	// 1 based like in inspect, 0 picks the first unused entry when adding
+	uint32_t index = 0;
+	// size expressions, see parse_size
+	std::string size;
+	std::string alignment = "1M";
+	// 0 lets the allocator place the partition
+	uint64_t start = 0;
+	std::string fit = "first";
+	// a GUID or one of the aliases for GPT, a hex OS type for MBR
+	std::string type;
+	std::string name;
+	uint64_t attributes = 0;
+	mdfs::IoEngineOptions io;
+};
+
+CLI::App *make_part_app(mdfs::PartInfo &info, CLI::App &app);
+int do_part(mdfs::PartInfo &info, const CLI::App *app);
+}// namespace mdfs
+
+#endif
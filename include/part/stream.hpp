@@ -0,0 +1,21 @@
+#ifndef MDFS_PART_STREAM_H
+#define MDFS_PART_STREAM_H
+
+#include <common/CLI11.hpp>
+#include <string>
+
+namespace mdfs {
+struct StreamInfo {
+	std::string layoutFile;
+	// size expression, see parse_size
+	std::string size;
+	// - writes to stdout
+	std::string output = "-";
+	std::string chunkSize = "1M";
+};
+
+CLI::App *make_stream_app(mdfs::StreamInfo &info, CLI::App &app);
+int do_stream(mdfs::StreamInfo &info, const CLI::App *app);
+}// namespace mdfs
+
+#endif
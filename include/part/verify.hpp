@@ -0,0 +1,41 @@
+#ifndef MDFS_PART_VERIFY_H
+#define MDFS_PART_VERIFY_H
+
+#include <common/CLI11.hpp>
+#include <common/io_engine.hpp>
+#include <string>
+#include <vector>
+
+namespace mdfs {
+struct VerifyInfo {
+	std::vector<std::string> images;
+	// 0 probes 512 and 4096 byte sectors for a GPT header
+	size_t sectorSize = 0;
+	// 0 uses one thread per hardware thread
+	size_t jobs = 0;
+	std::string format = "text";
+	mdfs::IoEngineOptions io = {.engine = "mmap", .progress = {}};
+};
+
+struct VerifyIssue {
+	// short machine readable name of the failed check, like "mbr" or "overlap"
+	const char *check;
+	std::string message;
+};
+
+struct VerifyReport {
+	std::string image;
+	size_t sectorSize = 0;
+	size_t partitionCount = 0;
+	std::vector<VerifyIssue> issues;
+
+	bool ok() const { return issues.empty(); }
+};
+
+CLI::App *make_verify_app(mdfs::VerifyInfo &info, CLI::App &app);
+int do_verify(mdfs::VerifyInfo &info, const CLI::App *app);
+// runs every check on one image, failures to open or read it are reported as issues as well
+VerifyReport verify_image(const std::string &path, size_t sectorSize, const mdfs::IoEngineOptions &io);
+}// namespace mdfs
+
+#endif
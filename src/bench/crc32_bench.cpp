@@ -0,0 +1,110 @@
+#include <algorithm>
+#include <chrono>
+#include <common/crc32.hpp>
+#include <common/units.hpp>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <vector>
+
+typedef uint32_t (*crc32_kernel_t)(uint32_t crc, const uint8_t *data, size_t length);
+typedef uint32_t (*crc32_copy_kernel_t)(uint32_t crc, uint8_t *dst, const uint8_t *src, size_t length);
+
+// runs the kernel over the buffer until at least 256 MiB went through it and returns the throughput in GB/s
+static double measure(crc32_kernel_t kernel, const std::vector<uint8_t> &buffer, size_t length) {
+	size_t iterations = std::max<size_t>(1, (256 * mdfs::units::mb) / length);
+	volatile uint32_t sink = 0;
+	auto start = std::chrono::steady_clock::now();
+	for (size_t i = 0; i < iterations; i++) { sink = kernel(sink, buffer.data(), length); }
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+	return double(iterations * length) / elapsed.count() / 1e9;
+}
+
+// same for the copying kernels, with a separate destination buffer
+static double measure_copy(crc32_copy_kernel_t kernel, const std::vector<uint8_t> &buffer, std::vector<uint8_t> &copy,
+						   size_t length) {
+	size_t iterations = std::max<size_t>(1, (256 * mdfs::units::mb) / length);
+	volatile uint32_t sink = 0;
+	auto start = std::chrono::steady_clock::now();
+	for (size_t i = 0; i < iterations; i++) { sink = kernel(sink, copy.data(), buffer.data(), length); }
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+	return double(iterations * length) / elapsed.count() / 1e9;
+}
+
+// the two pass baseline the fused kernels replace
+static uint32_t memcpy_then_crc(uint32_t crc, uint8_t *dst, const uint8_t *src, size_t length) {
+	memcpy(dst, src, length);
+	return ~mdfs::crc32(dst, length, crc);
+}
+
+int main() {
+	struct Kernel {
+		const char *name;
+		crc32_kernel_t kernel;
+	};
+	struct CopyKernel {
+		const char *name;
+		crc32_copy_kernel_t kernel;
+	};
+	std::vector<Kernel> kernels = {
+			{"bytewise", mdfs::crc32_kernels::bytewise},
+			{"slice16", mdfs::crc32_kernels::slice16},
+	};
+	std::vector<CopyKernel> copyKernels = {
+			{"memcpy+crc", memcpy_then_crc},
+			{"slice16", mdfs::crc32_kernels::copy_slice16},
+	};
+#if defined(__x86_64__) || defined(__i386__)
+	if (__builtin_cpu_supports("pclmul") && __builtin_cpu_supports("sse4.1")) {
+		kernels.push_back({"pclmul", mdfs::crc32_kernels::pclmul});
+		copyKernels.push_back({"pclmul", mdfs::crc32_kernels::copy_pclmul});
+	}
+	if (__builtin_cpu_supports("vpclmulqdq") && __builtin_cpu_supports("avx512f") &&
+		__builtin_cpu_supports("avx512vl")) {
+		kernels.push_back({"vpclmul", mdfs::crc32_kernels::vpclmul});
+		copyKernels.push_back({"vpclmul", mdfs::crc32_kernels::copy_vpclmul});
+	}
+#endif
+	const size_t lengths[] = {92, 512, 16 * mdfs::units::kb, 1 * mdfs::units::mb, 64 * mdfs::units::mb};
+
+	std::vector<uint8_t> buffer(64 * mdfs::units::mb);
+	std::vector<uint8_t> copy(buffer.size());
+	std::mt19937 rng(0);
+	for (auto &byte : buffer) { byte = uint8_t(rng()); }
+
+	for (const auto &k : kernels) {
+		if (k.kernel(0xFFFFFFFF, buffer.data(), buffer.size()) !=
+			mdfs::crc32_kernels::bytewise(0xFFFFFFFF, buffer.data(), buffer.size())) {
+			std::cerr << k.name << " doesn't match the reference\n";
+			return EXIT_FAILURE;
+		}
+	}
+	for (const auto &k : copyKernels) {
+		std::fill(copy.begin(), copy.end(), 0);
+		if (k.kernel(0xFFFFFFFF, copy.data(), buffer.data(), buffer.size()) !=
+					mdfs::crc32_kernels::bytewise(0xFFFFFFFF, buffer.data(), buffer.size()) ||
+			copy != buffer) {
+			std::cerr << "copying " << k.name << " doesn't match the reference\n";
+			return EXIT_FAILURE;
+		}
+	}
+
+	std::cout << "mdfs::crc32 dispatches to: " << mdfs::crc32_implementation() << "\n\n";
+	std::cout << std::left << std::setw(12) << "kernel";
+	for (size_t length : lengths) { std::cout << std::right << std::setw(12) << length; }
+	std::cout << "  (GB/s by buffer size in bytes)\n";
+	for (const auto &k : kernels) {
+		std::cout << std::left << std::setw(12) << k.name << std::right << std::fixed << std::setprecision(2);
+		for (size_t length : lengths) { std::cout << std::setw(12) << measure(k.kernel, buffer, length); }
+		std::cout << "\n";
+	}
+	std::cout << "\ncopy and checksum\n";
+	for (const auto &k : copyKernels) {
+		std::cout << std::left << std::setw(12) << k.name << std::right << std::fixed << std::setprecision(2);
+		for (size_t length : lengths) { std::cout << std::setw(12) << measure_copy(k.kernel, buffer, copy, length); }
+		std::cout << "\n";
+	}
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,139 @@
+#include <algorithm>
+#include <cerrno>
+#include <common/block_device.hpp>
+#include <common/clone.hpp>
+#include <common/extent_map.hpp>
+#include <common/util.hpp>
+#include <cstring>
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <optional>
+#include <stdexcept>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+const char *mdfs::clone_method_name(CloneMethod method) {
+	switch (method) {
+		case CloneMethod::REFLINK:
+			return "reflink";
+		case CloneMethod::EXTENTS:
+			return "copy_file_range";
+		case CloneMethod::BUFFERED:
+			return "buffered copy";
+		default:
+			return "auto";
+	}
+}
+
+namespace {
+class FileDescriptor {
+public:
+	FileDescriptor(int fd) : fd(fd) {}
+	~FileDescriptor() {
+		if (fd >= 0) { close(fd); }
+	}
+	int fd;
+};
+
+// errors meaning the file system or kernel can't do the operation at all, rather than that it failed
+bool unsupported(int error) {
+	return error == EOPNOTSUPP || error == ENOTTY || error == EXDEV || error == EINVAL || error == ENOSYS;
+}
+}// namespace
+
+// the end of the extent goes through the engines, chunks of zeros are skipped so they stay holes in dst
+static void copy_buffered(mdfs::BlockDevice &in, mdfs::BlockDevice &out, uint64_t offset, uint64_t end,
+						  std::vector<char> &buffer) {
+	while (offset < end) {
+		size_t chunk = size_t(std::min<uint64_t>(end - offset, buffer.size()));
+		in.read_at(offset, buffer.data(), chunk);
+		if (!mdfs::all_zeros(buffer.data(), chunk)) { out.write_at(offset, buffer.data(), chunk); }
+		offset += chunk;
+	}
+}
+
+static mdfs::CloneResult copy_extents(int src, int dst, const std::string &srcPath, const std::string &dstPath,
+									  uint64_t size, mdfs::CloneMethod method, const mdfs::IoEngineOptions &io) {
+	bool useCopyRange = method != mdfs::CloneMethod::BUFFERED;
+	mdfs::CloneResult result;
+	result.method = useCopyRange ? mdfs::CloneMethod::EXTENTS : mdfs::CloneMethod::BUFFERED;
+	// opened on the first extent that needs them
+	std::optional<mdfs::BlockDevice> in;
+	std::optional<mdfs::BlockDevice> out;
+	std::vector<char> buffer;
+
+	uint64_t offset = 0;
+	while (std::optional<mdfs::DataExtent> extent = mdfs::next_data_extent(src, offset, size)) {
+		auto [start, end] = *extent;
+		result.extents++;
+		result.dataBytes += end - start;
+		offset = start;
+		while (useCopyRange && offset < end) {
+			off_t inOffset = off_t(offset);
+			off_t outOffset = off_t(offset);
+			ssize_t copied = copy_file_range(src, &inOffset, dst, &outOffset, size_t(end - offset), 0);
+			if (copied > 0) {
+				offset += uint64_t(copied);
+			} else if (copied == 0) {
+				throw std::runtime_error("Source image ended early");
+			} else if (errno != EINTR) {
+				if (!unsupported(errno) || method == mdfs::CloneMethod::EXTENTS) {
+					mdfs::throw_errno("Failed to copy " + srcPath);
+				}
+				useCopyRange = false;
+			}
+		}
+		if (offset < end) {
+			if (!in) {
+				if (size % 512 != 0) { throw std::runtime_error("Image size is not a multiple of 512 bytes"); }
+				in.emplace(srcPath, 512, std::ios::in, io);
+				out.emplace(dstPath, 512, std::ios::in | std::ios::out, io);
+				buffer.resize(std::max<size_t>(io.requestSize, mdfs::units::mb));
+			}
+			result.method = mdfs::CloneMethod::BUFFERED;
+			copy_buffered(*in, *out, offset, end, buffer);
+		}
+		offset = end;
+	}
+	if (out) { out->flush(); }
+	return result;
+}
+
+mdfs::CloneResult mdfs::clone_image(const std::string &src, const std::string &dst, CloneMethod method,
+									bool overwrite, const IoEngineOptions &io) {
+	FileDescriptor in(open(src.c_str(), O_RDONLY | O_CLOEXEC));
+	if (in.fd < 0) { throw_errno("Failed to open " + src); }
+	struct stat st;
+	if (fstat(in.fd, &st) != 0) { throw_errno("Failed to stat " + src); }
+	if (!S_ISREG(st.st_mode)) { throw std::runtime_error(src + " is not a regular file"); }
+	uint64_t size = uint64_t(st.st_size);
+
+	// dst is only truncated once it's known not to be src, truncating first would empty the source
+	FileDescriptor out(open(dst.c_str(), O_RDWR | O_CREAT | O_CLOEXEC | (overwrite ? 0 : O_EXCL), 0644));
+	if (out.fd < 0) {
+		if (errno == EEXIST) { throw std::runtime_error("Failed to create " + dst + ": it already exists"); }
+		throw_errno("Failed to create " + dst);
+	}
+	struct stat dstSt;
+	if (fstat(out.fd, &dstSt) != 0) { throw_errno("Failed to stat " + dst); }
+	if (dstSt.st_dev == st.st_dev && dstSt.st_ino == st.st_ino) {
+		throw std::runtime_error("Failed to clone " + src + ": " + dst + " is the same file");
+	}
+	try {
+		if (overwrite && ftruncate(out.fd, 0) != 0) { throw_errno("Failed to truncate " + dst); }
+		if (method == CloneMethod::AUTO || method == CloneMethod::REFLINK) {
+			if (ioctl(out.fd, FICLONE, in.fd) == 0) {
+				return {.method = CloneMethod::REFLINK, .extents = 0, .dataBytes = size};
+			}
+			if (method == CloneMethod::REFLINK || !unsupported(errno)) { throw_errno("Failed to reflink " + src); }
+		}
+		// the holes of dst are whatever copy_extents doesn't write
+		if (ftruncate(out.fd, off_t(size)) != 0) { throw_errno("Failed to resize " + dst); }
+		return copy_extents(in.fd, out.fd, src, dst, size, method, io);
+	} catch (...) {
+		unlink(dst.c_str());
+		throw;
+	}
+}
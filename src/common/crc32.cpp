@@ -1,43 +1,215 @@
 #include <common/crc32.hpp>
 
 #include <array>
+#include <bit>
+#include <cstring>
+#include <vector>
 
-constexpr std::array<uint32_t, 256> crc32_table = {
-		0x00000000, 0x77073096, 0xEE0E612C, 0x990951BA, 0x076DC419, 0x706AF48F, 0xE963A535, 0x9E6495A3, 0x0EDB8832,
-		0x79DCB8A4, 0xE0D5E91E, 0x97D2D988, 0x09B64C2B, 0x7EB17CBD, 0xE7B82D07, 0x90BF1D91, 0x1DB71064, 0x6AB020F2,
-		0xF3B97148, 0x84BE41DE, 0x1ADAD47D, 0x6DDDE4EB, 0xF4D4B551, 0x83D385C7, 0x136C9856, 0x646BA8C0, 0xFD62F97A,
-		0x8A65C9EC, 0x14015C4F, 0x63066CD9, 0xFA0F3D63, 0x8D080DF5, 0x3B6E20C8, 0x4C69105E, 0xD56041E4, 0xA2677172,
-		0x3C03E4D1, 0x4B04D447, 0xD20D85FD, 0xA50AB56B, 0x35B5A8FA, 0x42B2986C, 0xDBBBC9D6, 0xACBCF940, 0x32D86CE3,
-		0x45DF5C75, 0xDCD60DCF, 0xABD13D59, 0x26D930AC, 0x51DE003A, 0xC8D75180, 0xBFD06116, 0x21B4F4B5, 0x56B3C423,
-		0xCFBA9599, 0xB8BDA50F, 0x2802B89E, 0x5F058808, 0xC60CD9B2, 0xB10BE924, 0x2F6F7C87, 0x58684C11, 0xC1611DAB,
-		0xB6662D3D, 0x76DC4190, 0x01DB7106, 0x98D220BC, 0xEFD5102A, 0x71B18589, 0x06B6B51F, 0x9FBFE4A5, 0xE8B8D433,
-		0x7807C9A2, 0x0F00F934, 0x9609A88E, 0xE10E9818, 0x7F6A0DBB, 0x086D3D2D, 0x91646C97, 0xE6635C01, 0x6B6B51F4,
-		0x1C6C6162, 0x856530D8, 0xF262004E, 0x6C0695ED, 0x1B01A57B, 0x8208F4C1, 0xF50FC457, 0x65B0D9C6, 0x12B7E950,
-		0x8BBEB8EA, 0xFCB9887C, 0x62DD1DDF, 0x15DA2D49, 0x8CD37CF3, 0xFBD44C65, 0x4DB26158, 0x3AB551CE, 0xA3BC0074,
-		0xD4BB30E2, 0x4ADFA541, 0x3DD895D7, 0xA4D1C46D, 0xD3D6F4FB, 0x4369E96A, 0x346ED9FC, 0xAD678846, 0xDA60B8D0,
-		0x44042D73, 0x33031DE5, 0xAA0A4C5F, 0xDD0D7CC9, 0x5005713C, 0x270241AA, 0xBE0B1010, 0xC90C2086, 0x5768B525,
-		0x206F85B3, 0xB966D409, 0xCE61E49F, 0x5EDEF90E, 0x29D9C998, 0xB0D09822, 0xC7D7A8B4, 0x59B33D17, 0x2EB40D81,
-		0xB7BD5C3B, 0xC0BA6CAD, 0xEDB88320, 0x9ABFB3B6, 0x03B6E20C, 0x74B1D29A, 0xEAD54739, 0x9DD277AF, 0x04DB2615,
-		0x73DC1683, 0xE3630B12, 0x94643B84, 0x0D6D6A3E, 0x7A6A5AA8, 0xE40ECF0B, 0x9309FF9D, 0x0A00AE27, 0x7D079EB1,
-		0xF00F9344, 0x8708A3D2, 0x1E01F268, 0x6906C2FE, 0xF762575D, 0x806567CB, 0x196C3671, 0x6E6B06E7, 0xFED41B76,
-		0x89D32BE0, 0x10DA7A5A, 0x67DD4ACC, 0xF9B9DF6F, 0x8EBEEFF9, 0x17B7BE43, 0x60B08ED5, 0xD6D6A3E8, 0xA1D1937E,
-		0x38D8C2C4, 0x4FDFF252, 0xD1BB67F1, 0xA6BC5767, 0x3FB506DD, 0x48B2364B, 0xD80D2BDA, 0xAF0A1B4C, 0x36034AF6,
-		0x41047A60, 0xDF60EFC3, 0xA867DF55, 0x316E8EEF, 0x4669BE79, 0xCB61B38C, 0xBC66831A, 0x256FD2A0, 0x5268E236,
-		0xCC0C7795, 0xBB0B4703, 0x220216B9, 0x5505262F, 0xC5BA3BBE, 0xB2BD0B28, 0x2BB45A92, 0x5CB36A04, 0xC2D7FFA7,
-		0xB5D0CF31, 0x2CD99E8B, 0x5BDEAE1D, 0x9B64C2B0, 0xEC63F226, 0x756AA39C, 0x026D930A, 0x9C0906A9, 0xEB0E363F,
-		0x72076785, 0x05005713, 0x95BF4A82, 0xE2B87A14, 0x7BB12BAE, 0x0CB61B38, 0x92D28E9B, 0xE5D5BE0D, 0x7CDCEFB7,
-		0x0BDBDF21, 0x86D3D2D4, 0xF1D4E242, 0x68DDB3F8, 0x1FDA836E, 0x81BE16CD, 0xF6B9265B, 0x6FB077E1, 0x18B74777,
-		0x88085AE6, 0xFF0F6A70, 0x66063BCA, 0x11010B5C, 0x8F659EFF, 0xF862AE69, 0x616BFFD3, 0x166CCF45, 0xA00AE278,
-		0xD70DD2EE, 0x4E048354, 0x3903B3C2, 0xA7672661, 0xD06016F7, 0x4969474D, 0x3E6E77DB, 0xAED16A4A, 0xD9D65ADC,
-		0x40DF0B66, 0x37D83BF0, 0xA9BCAE53, 0xDEBB9EC5, 0x47B2CF7F, 0x30B5FFE9, 0xBDBDF21C, 0xCABAC28A, 0x53B39330,
-		0x24B4A3A6, 0xBAD03605, 0xCDD70693, 0x54DE5729, 0x23D967BF, 0xB3667A2E, 0xC4614AB8, 0x5D681B02, 0x2A6F2B94,
-		0xB40BBE37, 0xC30C8EA1, 0x5A05DF1B, 0x2D02EF8D};
+// IEEE 802.3 polynomial, bit reflected
+#define CRC32_POLYNOMIAL 0xEDB88320
+
+typedef std::array<std::array<uint32_t, 256>, 16> crc32_tables_t;
+
+// table[0] is the classic byte at a time table, table[n] advances a byte through n more zero bytes, which lets
+// slice16 look up 16 input bytes independently
+static constexpr crc32_tables_t make_crc32_tables() {
+	crc32_tables_t tables = {};
+	for (uint32_t i = 0; i < 256; i++) {
+		uint32_t crc = i;
+		for (int bit = 0; bit < 8; bit++) { crc = (crc >> 1) ^ ((crc & 1) ? CRC32_POLYNOMIAL : 0); }
+		tables[0][i] = crc;
+	}
+	for (size_t t = 1; t < tables.size(); t++) {
+		for (uint32_t i = 0; i < 256; i++) {
+			tables[t][i] = (tables[t - 1][i] >> 8) ^ tables[0][tables[t - 1][i] & 0xFF];
+		}
+	}
+	return tables;
+}
+
+static constexpr crc32_tables_t crc32_tables = make_crc32_tables();
+static_assert(crc32_tables[0][1] == 0x77073096 && crc32_tables[0][128] == 0xEDB88320 &&
+			  crc32_tables[0][255] == 0x2D02EF8D);
+
+// 32x32 matrices over GF(2), column n is the image of bit n. feeding zero bytes through the CRC register is linear,
+// so shifting a CRC over 2^k zero bytes is one matrix-vector product with zero_operators[k]
+typedef std::array<uint32_t, 32> gf2_matrix_t;
+
+static constexpr uint32_t gf2_matrix_times(const gf2_matrix_t &matrix, uint32_t vector) {
+	uint32_t sum = 0;
+	for (size_t n = 0; vector != 0; n++, vector >>= 1) {
+		if (vector & 1) { sum ^= matrix[n]; }
+	}
+	return sum;
+}
+
+static constexpr gf2_matrix_t gf2_matrix_square(const gf2_matrix_t &matrix) {
+	gf2_matrix_t square = {};
+	for (size_t n = 0; n < 32; n++) { square[n] = gf2_matrix_times(matrix, matrix[n]); }
+	return square;
+}
+
+static constexpr std::array<gf2_matrix_t, 64> make_zero_operators() {
+	std::array<gf2_matrix_t, 64> operators = {};
+	// one zero bit
+	gf2_matrix_t op = {};
+	op[0] = CRC32_POLYNOMIAL;
+	for (size_t n = 1; n < 32; n++) { op[n] = uint32_t(1) << (n - 1); }
+	// one zero byte is 2^3 zero bits
+	for (int i = 0; i < 3; i++) { op = gf2_matrix_square(op); }
+	operators[0] = op;
+	for (size_t k = 1; k < operators.size(); k++) { operators[k] = gf2_matrix_square(operators[k - 1]); }
+	return operators;
+}
+
+static constexpr std::array<gf2_matrix_t, 64> zero_operators = make_zero_operators();
+
+// advances the CRC register over length zero bytes
+static uint32_t crc32_shift(uint32_t crc, uint64_t length) {
+	for (size_t k = 0; length != 0; k++, length >>= 1) {
+		if (length & 1) { crc = gf2_matrix_times(zero_operators[k], crc); }
+	}
+	return crc;
+}
+
+static inline uint32_t load_le32(const uint8_t *data) {
+	uint32_t value;
+	memcpy(&value, data, sizeof(value));
+	if constexpr (std::endian::native == std::endian::big) { value = __builtin_bswap32(value); }
+	return value;
+}
+
+uint32_t mdfs::crc32_kernels::bytewise(uint32_t crc, const uint8_t *data, size_t length) {
+	for (size_t i = 0; i < length; ++i) { crc = (crc >> 8) ^ crc32_tables[0][(crc ^ data[i]) & 0xFF]; }
+	return crc;
+}
+
+// the fused copy variant stores every block to dst right after loading it, while it is still in registers
+template<bool Copy>
+static inline uint32_t slice16_impl(uint32_t crc, uint8_t *dst, const uint8_t *data, size_t length) {
+	const auto &t = crc32_tables;
+	while (length >= 16) {
+		if constexpr (Copy) {
+			memcpy(dst, data, 16);
+			dst += 16;
+		}
+		uint32_t a = load_le32(data) ^ crc;
+		uint32_t b = load_le32(data + 4);
+		uint32_t c = load_le32(data + 8);
+		uint32_t d = load_le32(data + 12);
+		crc = t[15][a & 0xFF] ^ t[14][(a >> 8) & 0xFF] ^ t[13][(a >> 16) & 0xFF] ^ t[12][a >> 24] ^
+			  t[11][b & 0xFF] ^ t[10][(b >> 8) & 0xFF] ^ t[9][(b >> 16) & 0xFF] ^ t[8][b >> 24] ^
+			  t[7][c & 0xFF] ^ t[6][(c >> 8) & 0xFF] ^ t[5][(c >> 16) & 0xFF] ^ t[4][c >> 24] ^
+			  t[3][d & 0xFF] ^ t[2][(d >> 8) & 0xFF] ^ t[1][(d >> 16) & 0xFF] ^ t[0][d >> 24];
+		data += 16;
+		length -= 16;
+	}
+	if constexpr (Copy) { memcpy(dst, data, length); }
+	return mdfs::crc32_kernels::bytewise(crc, data, length);
+}
+
+uint32_t mdfs::crc32_kernels::slice16(uint32_t crc, const uint8_t *data, size_t length) {
+	return slice16_impl<false>(crc, nullptr, data, length);
+}
+
+uint32_t mdfs::crc32_kernels::copy_slice16(uint32_t crc, uint8_t *dst, const uint8_t *src, size_t length) {
+	return slice16_impl<true>(crc, dst, src, length);
+}
+
+typedef uint32_t (*crc32_kernel_t)(uint32_t crc, const uint8_t *data, size_t length);
+typedef uint32_t (*crc32_copy_kernel_t)(uint32_t crc, uint8_t *dst, const uint8_t *src, size_t length);
+
+struct Crc32Implementation {
+	const char *name;
+	crc32_kernel_t kernel;
+	crc32_copy_kernel_t copyKernel;
+};
+
+// compares both kernels against the byte at a time reference for a spread of lengths and alignments, covering the
+// head, main loop and tail paths of every kernel. the copy kernel also has to reproduce the source exactly without
+// touching the bytes around the destination
+static bool crc32_self_test(const Crc32Implementation &implementation) {
+	std::array<uint8_t, 4096 + 64> buffer;
+	std::array<uint8_t, 4096 + 128> copy;
+	uint32_t state = 0x12345678;
+	for (auto &byte : buffer) {
+		state = state * 1664525 + 1013904223;
+		byte = uint8_t(state >> 24);
+	}
+	for (size_t i = 0; i < 200; i++) {
+		state = state * 1664525 + 1013904223;
+		size_t offset = (state >> 8) % 64;
+		size_t length = (i < 64) ? i * 7 : (state >> 12) % 4096;
+		size_t copyOffset = 1 + (state >> 20) % 63;
+		uint32_t seed = state ^ 0xA5A5A5A5;
+		const uint8_t *data = buffer.data() + offset;
+		uint32_t expected = mdfs::crc32_kernels::bytewise(seed, data, length);
+		if (implementation.kernel(seed, data, length) != expected) { return false; }
+
+		copy.fill(0xCC);
+		if (implementation.copyKernel(seed, copy.data() + copyOffset, data, length) != expected ||
+			memcmp(copy.data() + copyOffset, data, length) != 0 || copy[copyOffset - 1] != 0xCC ||
+			copy[copyOffset + length] != 0xCC) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// picked once, on first use, from the fastest kernel the CPU supports that also passes the self test
+static Crc32Implementation select_crc32_implementation() {
+	std::vector<Crc32Implementation> candidates;
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("vpclmulqdq") && __builtin_cpu_supports("avx512f") &&
+		__builtin_cpu_supports("avx512vl") && __builtin_cpu_supports("pclmul") && __builtin_cpu_supports("sse4.1")) {
+		candidates.push_back({"vpclmul", mdfs::crc32_kernels::vpclmul, mdfs::crc32_kernels::copy_vpclmul});
+	}
+	if (__builtin_cpu_supports("pclmul") && __builtin_cpu_supports("sse4.1")) {
+		candidates.push_back({"pclmul", mdfs::crc32_kernels::pclmul, mdfs::crc32_kernels::copy_pclmul});
+	}
+#endif
+	for (const Crc32Implementation &candidate : candidates) {
+		if (crc32_self_test(candidate)) { return candidate; }
+	}
+	return {"slice16", mdfs::crc32_kernels::slice16, mdfs::crc32_kernels::copy_slice16};
+}
+
+static const Crc32Implementation &crc32_implementation_instance() {
+	static const Crc32Implementation implementation = select_crc32_implementation();
+	return implementation;
+}
+
+const char *mdfs::crc32_implementation() { return crc32_implementation_instance().name; }
 
 crc32_t mdfs::crc32(const void *data, size_t length, crc32_t init) {
-	const uint8_t *bytes = static_cast<const uint8_t *>(data);
-	uint32_t crc = init;
+	return ~crc32_implementation_instance().kernel(init, static_cast<const uint8_t *>(data), length);
+}
+
+crc32_t mdfs::copy_and_crc(void *dst, const void *src, size_t length, crc32_t init) {
+	return ~crc32_implementation_instance().copyKernel(init, static_cast<uint8_t *>(dst),
+													   static_cast<const uint8_t *>(src), length);
+}
+
+crc32_t mdfs::crc32_combine(crc32_t crcA, crc32_t crcB, uint64_t lengthB) {
+	// the pre and post inversions of both halves cancel out, only A's register has to be moved past B
+	return crc32_shift(crcA, lengthB) ^ crcB;
+}
+
+crc32_t mdfs::crc32_zeros(uint64_t length) { return ~crc32_shift(0xFFFFFFFF, length); }
+
+mdfs::Crc32 &mdfs::Crc32::update(const void *data, size_t length) {
+	m_state = crc32_implementation_instance().kernel(m_state, static_cast<const uint8_t *>(data), length);
+	return *this;
+}
 
-	for (size_t i = 0; i < length; ++i) { crc = (crc >> 8) ^ crc32_table[(crc ^ bytes[i]) & 0xFF]; }
+mdfs::Crc32 &mdfs::Crc32::update_zeros(uint64_t length) {
+	m_state = crc32_shift(m_state, length);
+	return *this;
+}
 
-	return ~crc;
-}
\ No newline at end of file
+mdfs::Crc32 &mdfs::Crc32::copy_and_update(void *dst, const void *src, size_t length) {
+	m_state = crc32_implementation_instance().copyKernel(m_state, static_cast<uint8_t *>(dst),
+														 static_cast<const uint8_t *>(src), length);
+	return *this;
+}
@@ -0,0 +1,181 @@
+#include <common/crc32.hpp>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+
+// folding constants for the bit reflected IEEE polynomial. folding a 128 bit lane forward by D bits multiplies its
+// low quadword by (x^(D+32) mod P)' << 1 and its high quadword by (x^(D-32) mod P)' << 1
+#define CRC32_FOLD_2048_LO 0x11542778a
+#define CRC32_FOLD_2048_HI 0x1322d1430
+#define CRC32_FOLD_512_LO 0x154442bd4
+#define CRC32_FOLD_512_HI 0x1c6e41596
+#define CRC32_FOLD_384_LO 0x03db1ecdc
+#define CRC32_FOLD_384_HI 0x174359406
+#define CRC32_FOLD_256_LO 0x0f1da05aa
+#define CRC32_FOLD_256_HI 0x15a546366
+#define CRC32_FOLD_128_LO 0x1751997d0
+#define CRC32_FOLD_128_HI 0x0ccaa009e
+// (x^64 mod P)' << 1, and the reflected polynomial and Barrett constant floor(x^64 / P) used for the final reduction
+#define CRC32_FOLD_64 0x163cd6124
+#define CRC32_POLY_REFLECTED 0x1db710641
+#define CRC32_BARRETT_MU 0x1f7011641
+
+#define CLMUL_TARGET __attribute__((target("pclmul,sse4.1")))
+#define VPCLMUL_TARGET __attribute__((target("avx512f,avx512vl,vpclmulqdq,pclmul,sse4.1")))
+
+CLMUL_TARGET static inline __m128i fold128(__m128i x, __m128i k) {
+	return _mm_xor_si128(_mm_clmulepi64_si128(x, k, 0x00), _mm_clmulepi64_si128(x, k, 0x11));
+}
+
+// loads 16 or 64 bytes of input and, for the fused copy kernels, stores them to the destination on the way
+template<bool Copy>
+CLMUL_TARGET static inline __m128i load128(const uint8_t *src, uint8_t *dst) {
+	__m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src));
+	if constexpr (Copy) { _mm_storeu_si128(reinterpret_cast<__m128i *>(dst), x); }
+	return x;
+}
+
+template<bool Copy>
+VPCLMUL_TARGET static inline __m512i load512(const uint8_t *src, uint8_t *dst) {
+	__m512i z = _mm512_loadu_si512(src);
+	if constexpr (Copy) { _mm512_storeu_si512(dst, z); }
+	return z;
+}
+
+template<bool Copy>
+static inline uint32_t slice16_tail(uint32_t crc, uint8_t *dst, const uint8_t *src, size_t length) {
+	if constexpr (Copy) { return mdfs::crc32_kernels::copy_slice16(crc, dst, src, length); }
+	return mdfs::crc32_kernels::slice16(crc, src, length);
+}
+
+// folds the remaining 16 byte blocks into x and reduces it to the 32 bit CRC register
+template<bool Copy>
+CLMUL_TARGET static inline uint32_t finish128(__m128i x, const uint8_t *&src, uint8_t *&dst, size_t &length) {
+	const __m128i k128 = _mm_set_epi64x(CRC32_FOLD_128_HI, CRC32_FOLD_128_LO);
+	while (length >= 16) {
+		x = _mm_xor_si128(fold128(x, k128), load128<Copy>(src, dst));
+		src += 16;
+		dst += Copy ? 16 : 0;
+		length -= 16;
+	}
+
+	// 128 -> 64 bits
+	x = _mm_xor_si128(_mm_clmulepi64_si128(x, k128, 0x10), _mm_srli_si128(x, 8));
+	// 64 -> 32 bits
+	const __m128i mask32 = _mm_set_epi32(0, 0, 0, -1);
+	x = _mm_xor_si128(_mm_clmulepi64_si128(_mm_and_si128(x, mask32), _mm_set_epi64x(0, CRC32_FOLD_64), 0x00),
+					  _mm_srli_si128(x, 4));
+	// Barrett reduction
+	const __m128i barrett = _mm_set_epi64x(CRC32_BARRETT_MU, CRC32_POLY_REFLECTED);
+	__m128i t = _mm_clmulepi64_si128(_mm_and_si128(x, mask32), barrett, 0x10);
+	t = _mm_clmulepi64_si128(_mm_and_si128(t, mask32), barrett, 0x00);
+	return uint32_t(_mm_extract_epi32(_mm_xor_si128(x, t), 1));
+}
+
+template<bool Copy>
+CLMUL_TARGET static uint32_t pclmul_impl(uint32_t crc, uint8_t *dst, const uint8_t *src, size_t length) {
+	if (length < 64) { return slice16_tail<Copy>(crc, dst, src, length); }
+
+	__m128i x0 = _mm_xor_si128(load128<Copy>(src, dst), _mm_cvtsi32_si128(int(crc)));
+	__m128i x1 = load128<Copy>(src + 16, dst + 16);
+	__m128i x2 = load128<Copy>(src + 32, dst + 32);
+	__m128i x3 = load128<Copy>(src + 48, dst + 48);
+	src += 64;
+	dst += Copy ? 64 : 0;
+	length -= 64;
+
+	const __m128i k512 = _mm_set_epi64x(CRC32_FOLD_512_HI, CRC32_FOLD_512_LO);
+	while (length >= 64) {
+		x0 = _mm_xor_si128(fold128(x0, k512), load128<Copy>(src, dst));
+		x1 = _mm_xor_si128(fold128(x1, k512), load128<Copy>(src + 16, dst + 16));
+		x2 = _mm_xor_si128(fold128(x2, k512), load128<Copy>(src + 32, dst + 32));
+		x3 = _mm_xor_si128(fold128(x3, k512), load128<Copy>(src + 48, dst + 48));
+		src += 64;
+		dst += Copy ? 64 : 0;
+		length -= 64;
+	}
+
+	const __m128i k128 = _mm_set_epi64x(CRC32_FOLD_128_HI, CRC32_FOLD_128_LO);
+	__m128i x = _mm_xor_si128(fold128(x0, k128), x1);
+	x = _mm_xor_si128(fold128(x, k128), x2);
+	x = _mm_xor_si128(fold128(x, k128), x3);
+
+	crc = finish128<Copy>(x, src, dst, length);
+	return slice16_tail<Copy>(crc, dst, src, length);
+}
+
+VPCLMUL_TARGET static inline __m512i fold512(__m512i z, __m512i k, __m512i data) {
+	return _mm512_ternarylogic_epi64(_mm512_clmulepi64_epi128(z, k, 0x00), _mm512_clmulepi64_epi128(z, k, 0x11), data,
+									 0x96);
+}
+
+// the same pair of constants in every 128 bit lane. set directly, broadcasting a 128 bit value makes GCC report its
+// undefined upper source operand as maybe uninitialized
+VPCLMUL_TARGET static inline __m512i fold_constant512(long long hi, long long lo) {
+	return _mm512_set_epi64(hi, lo, hi, lo, hi, lo, hi, lo);
+}
+
+template<bool Copy>
+VPCLMUL_TARGET static uint32_t vpclmul_impl(uint32_t crc, uint8_t *dst, const uint8_t *src, size_t length) {
+	if (length < 256) { return pclmul_impl<Copy>(crc, dst, src, length); }
+
+	__m512i z0 = _mm512_xor_si512(load512<Copy>(src, dst),
+								  _mm512_inserti32x4(_mm512_setzero_si512(), _mm_cvtsi32_si128(int(crc)), 0));
+	__m512i z1 = load512<Copy>(src + 64, dst + 64);
+	__m512i z2 = load512<Copy>(src + 128, dst + 128);
+	__m512i z3 = load512<Copy>(src + 192, dst + 192);
+	src += 256;
+	dst += Copy ? 256 : 0;
+	length -= 256;
+
+	const __m512i k2048 = fold_constant512(CRC32_FOLD_2048_HI, CRC32_FOLD_2048_LO);
+	while (length >= 256) {
+		z0 = fold512(z0, k2048, load512<Copy>(src, dst));
+		z1 = fold512(z1, k2048, load512<Copy>(src + 64, dst + 64));
+		z2 = fold512(z2, k2048, load512<Copy>(src + 128, dst + 128));
+		z3 = fold512(z3, k2048, load512<Copy>(src + 192, dst + 192));
+		src += 256;
+		dst += Copy ? 256 : 0;
+		length -= 256;
+	}
+
+	const __m512i k512 = fold_constant512(CRC32_FOLD_512_HI, CRC32_FOLD_512_LO);
+	__m512i z = fold512(z0, k512, z1);
+	z = fold512(z, k512, z2);
+	z = fold512(z, k512, z3);
+	while (length >= 64) {
+		z = fold512(z, k512, load512<Copy>(src, dst));
+		src += 64;
+		dst += Copy ? 64 : 0;
+		length -= 64;
+	}
+
+	// the four lanes sit 384, 256, 128 and 0 bits before the end of the folded data. they go through memory once
+	// instead of _mm512_extracti32x4_epi32, whose undefined source operand GCC reports as maybe uninitialized
+	alignas(64) __m128i lanes[4];
+	_mm512_store_si512(lanes, z);
+	__m128i x = lanes[3];
+	x = _mm_xor_si128(x, fold128(lanes[0], _mm_set_epi64x(CRC32_FOLD_384_HI, CRC32_FOLD_384_LO)));
+	x = _mm_xor_si128(x, fold128(lanes[1], _mm_set_epi64x(CRC32_FOLD_256_HI, CRC32_FOLD_256_LO)));
+	x = _mm_xor_si128(x, fold128(lanes[2], _mm_set_epi64x(CRC32_FOLD_128_HI, CRC32_FOLD_128_LO)));
+
+	crc = finish128<Copy>(x, src, dst, length);
+	return slice16_tail<Copy>(crc, dst, src, length);
+}
+
+uint32_t mdfs::crc32_kernels::pclmul(uint32_t crc, const uint8_t *data, size_t length) {
+	return pclmul_impl<false>(crc, nullptr, data, length);
+}
+
+uint32_t mdfs::crc32_kernels::vpclmul(uint32_t crc, const uint8_t *data, size_t length) {
+	return vpclmul_impl<false>(crc, nullptr, data, length);
+}
+
+uint32_t mdfs::crc32_kernels::copy_pclmul(uint32_t crc, uint8_t *dst, const uint8_t *src, size_t length) {
+	return pclmul_impl<true>(crc, dst, src, length);
+}
+
+uint32_t mdfs::crc32_kernels::copy_vpclmul(uint32_t crc, uint8_t *dst, const uint8_t *src, size_t length) {
+	return vpclmul_impl<true>(crc, dst, src, length);
+}
+#endif
@@ -0,0 +1,56 @@
+#include <algorithm>
+#include <cerrno>
+#include <common/extent_map.hpp>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/stat.h>
+#include <unistd.h>
+
+std::optional<mdfs::DataExtent> mdfs::next_data_extent(int fd, uint64_t offset, uint64_t size) {
+	if (offset >= size) { return std::nullopt; }
+	off_t data = lseek(fd, off_t(offset), SEEK_DATA);
+	if (data < 0) {
+		if (errno == ENXIO) { return std::nullopt; }
+		if (errno != EINVAL) {
+			throw std::runtime_error(std::string("Failed to find the data in an image: ") + strerror(errno));
+		}
+		return DataExtent{offset, size};
+	}
+	if (uint64_t(data) >= size) { return std::nullopt; }
+	off_t hole = lseek(fd, data, SEEK_HOLE);
+	if (hole < 0) { throw std::runtime_error(std::string("Failed to find the holes in an image: ") + strerror(errno)); }
+	return DataExtent{uint64_t(data), std::min<uint64_t>(uint64_t(hole), size)};
+}
+
+mdfs::ExtentMap::ExtentMap(int fd, uint64_t size) : m_size(size) {
+	uint64_t offset = 0;
+	while (std::optional<DataExtent> extent = next_data_extent(fd, offset, size)) {
+		m_extents.push_back(*extent);
+		offset = extent->end;
+	}
+}
+
+mdfs::ExtentMap::ExtentMap(const std::string &path) {
+	int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd < 0) { throw std::runtime_error("Failed to open " + path + ": " + strerror(errno)); }
+	struct stat st;
+	if (fstat(fd, &st) != 0) {
+		close(fd);
+		throw std::runtime_error("Failed to stat " + path + ": " + strerror(errno));
+	}
+	try {
+		*this = ExtentMap(fd, uint64_t(st.st_size));
+	} catch (...) {
+		close(fd);
+		throw;
+	}
+	close(fd);
+}
+
+bool mdfs::ExtentMap::is_hole(uint64_t offset, uint64_t length) const {
+	// the first extent ending after offset is the only one that can overlap the range first
+	auto it = std::upper_bound(m_extents.begin(), m_extents.end(), offset,
+							   [](uint64_t value, const DataExtent &extent) { return value < extent.end; });
+	return it == m_extents.end() || it->offset >= offset + length;
+}
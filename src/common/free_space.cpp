@@ -0,0 +1,126 @@
+#include <algorithm>
+#include <common/free_space.hpp>
+#include <iterator>
+
+uint64_t mdfs::FreeSpaceMap::aligned_start(const Extent &extent, uint64_t alignment) {
+	return (extent.first + alignment - 1) / alignment * alignment;
+}
+
+bool mdfs::FreeSpaceMap::fits(const Extent &extent, uint64_t sizeInLBA, uint64_t alignment) {
+	uint64_t start = aligned_start(extent, alignment);
+	return start <= extent.last && extent.last - start + 1 >= sizeInLBA;
+}
+
+void mdfs::FreeSpaceMap::insert(uint64_t first, uint64_t last) {
+	uint64_t size = last - first + 1;
+	m_byStart.emplace(first, last);
+	m_bySize.emplace(size, first);
+	m_byClass[size_class(size)].emplace(first, last);
+}
+
+void mdfs::FreeSpaceMap::erase(std::map<uint64_t, uint64_t>::iterator it) {
+	uint64_t size = it->second - it->first + 1;
+	m_bySize.erase({size, it->first});
+	m_byClass[size_class(size)].erase(it->first);
+	m_byStart.erase(it);
+}
+
+mdfs::Result mdfs::FreeSpaceMap::reserve(uint64_t first, uint64_t last) {
+	if (first > last) { return Result::FAILURE; }
+	auto it = m_byStart.upper_bound(first);
+	if (it == m_byStart.begin()) { return Result::FAILURE; }
+	--it;
+	Extent extent = {it->first, it->second};
+	if (last > extent.last) { return Result::FAILURE; }
+
+	erase(it);
+	if (first > extent.first) { insert(extent.first, first - 1); }
+	if (last < extent.last) { insert(last + 1, extent.last); }
+	return Result::SUCCESS;
+}
+
+void mdfs::FreeSpaceMap::release(uint64_t first, uint64_t last) {
+	if (first > last) { return; }
+	auto next = m_byStart.upper_bound(first);
+	if (next != m_byStart.begin()) {
+		auto previous = std::prev(next);
+		if (previous->second + 1 == first) {
+			first = previous->first;
+			erase(previous);
+		}
+	}
+	if (next != m_byStart.end() && next->first == last + 1) {
+		last = next->second;
+		erase(next);
+	}
+	insert(first, last);
+}
+
+std::optional<uint64_t> mdfs::FreeSpaceMap::find(uint64_t sizeInLBA, uint64_t alignment, Fit fit) const {
+	if (sizeInLBA == 0) { return std::nullopt; }
+	alignment = alignment ? alignment : 1;
+
+	if (fit == Fit::BEST) {
+		// the first extent by size that fits, skipping the ones that only fail because of the alignment
+		for (auto it = m_bySize.lower_bound({sizeInLBA, 0}); it != m_bySize.end(); ++it) {
+			Extent extent = {it->second, it->second + it->first - 1};
+			if (fits(extent, sizeInLBA, alignment)) { return aligned_start(extent, alignment); }
+		}
+		return std::nullopt;
+	}
+
+	// any extent of at least sizeInLBA + alignment - 1 sectors fits wherever it starts, so every class from the
+	// one of that size up only has to offer its lowest start. the classes below it may hold extents that fit or not
+	// and are walked in order of their starts, up to the best start found so far. that walk is what makes a first fit
+	// linear in the worst case, see the class comment
+	std::optional<uint64_t> best;
+	uint64_t guaranteed = sizeInLBA + alignment - 1;
+	size_t firstGuaranteed = guaranteed < sizeInLBA ? 64 : (guaranteed == 1 ? 0 : 64 - __builtin_clzll(guaranteed - 1));
+	for (size_t sizeClass = firstGuaranteed; sizeClass < m_byClass.size(); sizeClass++) {
+		if (m_byClass[sizeClass].empty()) { continue; }
+		uint64_t start = m_byClass[sizeClass].begin()->first;
+		if (!best || start < *best) { best = start; }
+	}
+	for (size_t sizeClass = size_class(sizeInLBA); sizeClass < std::min<size_t>(firstGuaranteed, m_byClass.size());
+		 sizeClass++) {
+		for (auto [start, last] : m_byClass[sizeClass]) {
+			if (best && start >= *best) { break; }
+			if (fits({start, last}, sizeInLBA, alignment)) {
+				best = start;
+				break;
+			}
+		}
+	}
+	if (!best) { return std::nullopt; }
+	return aligned_start({*best, m_byStart.at(*best)}, alignment);
+}
+
+std::optional<mdfs::FreeSpaceMap::Extent> mdfs::FreeSpaceMap::extent_at(uint64_t LBA) const {
+	auto it = m_byStart.upper_bound(LBA);
+	if (it == m_byStart.begin()) { return std::nullopt; }
+	--it;
+	if (LBA > it->second) { return std::nullopt; }
+	return Extent{it->first, it->second};
+}
+
+std::optional<mdfs::FreeSpaceMap::Extent> mdfs::FreeSpaceMap::largest(uint64_t alignment) const {
+	// alignment costs an extent less than alignment sectors, so only the extents that can still beat the best one
+	// after that are looked at
+	alignment = alignment ? alignment : 1;
+	std::optional<Extent> best;
+	for (auto it = m_bySize.rbegin(); it != m_bySize.rend(); ++it) {
+		if (best && it->first <= best->size()) { break; }
+		Extent extent = {it->second, it->second + it->first - 1};
+		uint64_t start = aligned_start(extent, alignment);
+		if (start > extent.last) { continue; }
+		if (!best || extent.last - start + 1 > best->size()) { best = Extent{start, extent.last}; }
+	}
+	return best;
+}
+
+std::vector<mdfs::FreeSpaceMap::Extent> mdfs::FreeSpaceMap::extents() const {
+	std::vector<Extent> extents;
+	extents.reserve(m_byStart.size());
+	for (auto [first, last] : m_byStart) { extents.push_back({first, last}); }
+	return extents;
+}
@@ -0,0 +1,59 @@
+#include <common/fstream_engine.hpp>
+#include <fcntl.h>
+#include <stdexcept>
+#include <unistd.h>
+
+void mdfs::FstreamEngine::open(const std::string &path, size_t blockSize, std::ios_base::openmode openmode) {
+	close();
+	if (m_direct) { throw std::runtime_error("The fstream engine doesn't support direct I/O"); }
+	m_path = path;
+	m_blockSize = blockSize;
+	m_writable = openmode & std::ios::out;
+	// opening with std::ios::out alone would truncate the image, so writable images are always opened in|out
+	m_file.open(path, (m_writable ? std::ios::in | std::ios::out : std::ios::in) | std::ios::binary);
+	if (!m_file.is_open()) { throw std::runtime_error("Failed to open image"); }
+	m_file.seekg(0, std::ios::end);
+	m_fileSize = m_file.tellg();
+	m_file.seekg(0);
+}
+
+void mdfs::FstreamEngine::close() {
+	if (m_file.is_open()) { m_file.close(); }
+	if (m_fd >= 0) {
+		::close(m_fd);
+		m_fd = -1;
+	}
+	m_fileSize = 0;
+}
+
+void mdfs::FstreamEngine::read_lba(size_t LBA, char *data, size_t sizeInLBA) {
+	m_file.seekg(mdfs::lba_to_addr(LBA, m_blockSize));
+	m_file.read(data, mdfs::lba_to_addr(sizeInLBA, m_blockSize));
+}
+
+void mdfs::FstreamEngine::write_lba(size_t LBA, const char *data, size_t sizeInLBA) {
+	m_file.seekp(mdfs::lba_to_addr(LBA, m_blockSize));
+	m_file.write(data, mdfs::lba_to_addr(sizeInLBA, m_blockSize));
+}
+
+void mdfs::FstreamEngine::zero_lba(size_t LBA, size_t sizeInLBA) {
+	if (m_fd < 0 && m_writable) { m_fd = ::open(m_path.c_str(), O_WRONLY | O_CLOEXEC); }
+	if (m_fd >= 0) {
+		m_file.flush();
+		Result res = zero_range_native(m_fd, mdfs::lba_to_addr(LBA, m_blockSize),
+									   mdfs::lba_to_addr(sizeInLBA, m_blockSize));
+		if (res == Result::SUCCESS) { return; }
+	}
+	IoEngine::zero_lba(LBA, sizeInLBA);
+}
+
+void mdfs::FstreamEngine::sync_lba(size_t /*LBA*/, size_t /*sizeInLBA*/) {
+	if (!m_writable) { return; }
+	if (m_fd < 0) { m_fd = ::open(m_path.c_str(), O_WRONLY | O_CLOEXEC); }
+	m_file.flush();
+	if (m_fd < 0 || fdatasync(m_fd) != 0) { throw std::runtime_error("Failed to sync image"); }
+}
+
+std::unique_ptr<mdfs::IoEngine> mdfs::FstreamEngine::create(const IoEngineOptions &options) {
+	return std::make_unique<FstreamEngine>(options);
+}
@@ -0,0 +1,184 @@
+#include <algorithm>
+#include <common/crc32.hpp>
+#include <common/gpt_editor.hpp>
+#include <cstring>
+#include <iterator>
+
+mdfs::Result mdfs::GptEditor::load() {
+	PartitionTableReader reader(m_disk);
+	if (reader.read() != Result::SUCCESS || !reader.active()) { return Result::FAILURE; }
+	const GptCopy &active = *reader.active();
+	const HeaderGPT &header = *active.header;
+	size_t blockSize = m_disk.block_size();
+
+	m_entryBytes = active.entries.size();
+	size_t sectors = mdfs::align_up<size_t>(m_entryBytes, blockSize) / blockSize;
+	m_entries.assign(sectors * blockSize, std::byte(0));
+	memcpy(m_entries.data(), active.entries.data(), m_entryBytes);
+	m_sectorCRCs.resize(sectors);
+	for (size_t i = 0; i < sectors; i++) { m_sectorCRCs[i] = sector_crc(i); }
+	m_dirty.assign(sectors, 0);
+	m_dirtySectors = 0;
+	m_headersDirty = false;
+
+	const GptCopy &primary = reader.primary();
+	const GptCopy &backup = reader.backup();
+	m_rewritePrimary = !primary.valid();
+	m_rewriteBackup = !backup.valid();
+	if (primary.valid() && backup.valid()) {
+		// the primary wins whenever the two disagree
+		const HeaderGPT &p = *primary.header;
+		const HeaderGPT &b = *backup.header;
+		m_rewriteBackup = b.alternateLBA != p.myLBA || b.firstUsableLBA != p.firstUsableLBA ||
+						  b.lastUsableLBA != p.lastUsableLBA || memcmp(&b.diskGUID, &p.diskGUID, sizeof(GUID)) != 0 ||
+						  b.numberOfPartitionEntries != p.numberOfPartitionEntries ||
+						  b.sizeOfPartitionEntries != p.sizeOfPartitionEntries ||
+						  memcmp(backup.entries.data(), primary.entries.data(), m_entryBytes) != 0;
+	}
+
+	std::span<const std::byte> sector(reinterpret_cast<const std::byte *>(&header), blockSize);
+	m_primaryHeader.assign(sector.begin(), sector.end());
+	m_backupHeader.assign(sector.begin(), sector.end());
+	if (primary.valid()) {
+		memcpy(m_primaryHeader.data(), primary.header, blockSize);
+	} else {
+		// rebuilt from the backup, the primary always lives in LBA 1 with its entries right behind it
+		HeaderGPT &rebuilt = header_of(m_primaryHeader);
+		rebuilt.myLBA = 1;
+		rebuilt.alternateLBA = header.myLBA;
+		rebuilt.partitionEntryLBA = 2;
+	}
+	if (backup.valid()) { memcpy(m_backupHeader.data(), backup.header, blockSize); }
+	if (m_rewriteBackup) {
+		// the backup takes the last LBA, with its entries right after the usable range
+		HeaderGPT &rebuilt = header_of(m_backupHeader);
+		rebuilt = header_of(m_primaryHeader);
+		rebuilt.myLBA = m_disk.size_lba() - 1;
+		rebuilt.alternateLBA = header_of(m_primaryHeader).myLBA;
+		rebuilt.partitionEntryLBA = rebuilt.lastUsableLBA + 1;
+		header_of(m_primaryHeader).alternateLBA = rebuilt.myLBA;
+		if (rebuilt.partitionEntryLBA + sectors > rebuilt.myLBA) { return Result::FAILURE; }
+	}
+	m_headersDirty = m_rewritePrimary || m_rewriteBackup;
+	return Result::SUCCESS;
+}
+
+void mdfs::GptEditor::set_entry(uint32_t index, const PartitionEntryGPT &entry) {
+	uint64_t offset = uint64_t(index) * header().sizeOfPartitionEntries;
+	if (memcmp(m_entries.data() + offset, &entry, sizeof(PartitionEntryGPT)) == 0) { return; }
+	memcpy(m_entries.data() + offset, &entry, sizeof(PartitionEntryGPT));
+	mark_dirty(offset, sizeof(PartitionEntryGPT));
+}
+
+void mdfs::GptEditor::clear_entry(uint32_t index) {
+	// the whole slot is zeroed, including any bytes past the standard 128 byte entry
+	uint64_t offset = uint64_t(index) * header().sizeOfPartitionEntries;
+	size_t length = header().sizeOfPartitionEntries;
+	std::byte *slot = m_entries.data() + offset;
+	if (std::all_of(slot, slot + length, [](std::byte b) { return b == std::byte(0); })) { return; }
+	memset(slot, 0x00, length);
+	mark_dirty(offset, length);
+}
+
+void mdfs::GptEditor::set_disk_guid(const GUID &guid) {
+	header_of(m_primaryHeader).diskGUID = guid;
+	header_of(m_backupHeader).diskGUID = guid;
+	m_headersDirty = true;
+}
+
+void mdfs::GptEditor::mark_dirty(uint64_t offset, size_t length) {
+	size_t blockSize = m_disk.block_size();
+	for (size_t sector = offset / blockSize; sector <= (offset + length - 1) / blockSize; sector++) {
+		if (m_dirty[sector]) { continue; }
+		m_dirty[sector] = 1;
+		m_dirtySectors++;
+	}
+}
+
+crc32_t mdfs::GptEditor::sector_crc(size_t sector) const {
+	// the array doesn't have to end on a sector boundary, the padding after it isn't covered by the CRC
+	size_t blockSize = m_disk.block_size();
+	size_t start = sector * blockSize;
+	return crc32(m_entries.data() + start, std::min(blockSize, m_entryBytes - start));
+}
+
+void mdfs::GptEditor::finish_header(std::vector<std::byte> &sector, crc32_t entriesCRC) {
+	HeaderGPT &header = header_of(sector);
+	header.partitionEntryArrayCRC32 = entriesCRC;
+	header.headerCRC32 = 0;
+	header.headerCRC32 = crc32(sector.data(), header.headerSize);
+}
+
+void mdfs::GptEditor::write_copy(const std::vector<std::byte> &headerSector, bool all) {
+	const HeaderGPT &header = header_of(headerSector);
+	size_t blockSize = m_disk.block_size();
+	WriteBatch batch;
+	for (size_t sector = 0; sector < entry_sectors(); sector++) {
+		if (all || m_dirty[sector]) {
+			batch.add(header.partitionEntryLBA + sector, m_entries.data() + sector * blockSize, 1);
+		}
+	}
+	m_disk.submit(batch);
+	m_disk.sync(header.partitionEntryLBA, entry_sectors());
+	m_disk.write_lba(header.myLBA, reinterpret_cast<const char *>(headerSector.data()), 1);
+	m_disk.sync(header.myLBA, 1);
+}
+
+mdfs::Result mdfs::GptEditor::commit() {
+	if (!dirty()) { return Result::NO_WORK; }
+
+	// only the dirty sectors are checksummed again, the array CRC is merged from the per sector ones
+	size_t blockSize = m_disk.block_size();
+	crc32_t entriesCRC = 0;
+	for (size_t sector = 0; sector < entry_sectors(); sector++) {
+		if (m_dirty[sector]) { m_sectorCRCs[sector] = sector_crc(sector); }
+		size_t length = std::min(blockSize, m_entryBytes - sector * blockSize);
+		entriesCRC = crc32_combine(entriesCRC, m_sectorCRCs[sector], length);
+	}
+	finish_header(m_primaryHeader, entriesCRC);
+	finish_header(m_backupHeader, entriesCRC);
+
+	write_copy(m_backupHeader, m_rewriteBackup);
+	write_copy(m_primaryHeader, m_rewritePrimary);
+
+	std::fill(m_dirty.begin(), m_dirty.end(), 0);
+	m_dirtySectors = 0;
+	m_headersDirty = false;
+	m_rewritePrimary = false;
+	m_rewriteBackup = false;
+	return Result::SUCCESS;
+}
+
+mdfs::Result mdfs::set_gpt_partition_name(PartitionEntryGPT &entry, std::string_view name) {
+	char16_t units[sizeof(entry.partitionName) / sizeof(char16_t)] = {};
+	size_t length = 0;
+	for (size_t i = 0; i < name.size();) {
+		uint8_t lead = uint8_t(name[i]);
+		size_t trailing = lead < 0x80 ? 0 : (lead >> 5) == 0x6 ? 1 : (lead >> 4) == 0xE ? 2 : (lead >> 3) == 0x1E ? 3 : 4;
+		if (trailing == 4 || i + trailing >= name.size()) { return Result::FAILURE; }
+		uint32_t code = trailing == 0 ? lead : lead & (0x3F >> trailing);
+		for (size_t j = 1; j <= trailing; j++) {
+			uint8_t next = uint8_t(name[i + j]);
+			if ((next & 0xC0) != 0x80) { return Result::FAILURE; }
+			code = (code << 6) | (next & 0x3F);
+		}
+		i += trailing + 1;
+
+		// overlong encodings, surrogates and code points past U+10FFFF aren't valid UTF-8
+		const uint32_t smallest[] = {0, 0x80, 0x800, 0x10000};
+		if (code < smallest[trailing] || (code >= 0xD800 && code < 0xE000) || code > 0x10FFFF) {
+			return Result::FAILURE;
+		}
+		if (code >= 0x10000) {
+			if (length + 2 > std::size(units)) { return Result::FAILURE; }
+			code -= 0x10000;
+			units[length++] = char16_t(0xD800 + (code >> 10));
+			units[length++] = char16_t(0xDC00 + (code & 0x3FF));
+		} else {
+			if (length + 1 > std::size(units)) { return Result::FAILURE; }
+			units[length++] = char16_t(code);
+		}
+	}
+	memcpy(entry.partitionName, units, sizeof(units));
+	return Result::SUCCESS;
+}
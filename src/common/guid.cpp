@@ -1,66 +1,94 @@
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
 #include <common/guid.hpp>
-#include <fstream>
-#include <iomanip>
+#include <cstring>
 #include <iostream>
-#include <regex>
+#include <pthread.h>
+#include <sys/random.h>
+#include <vector>
 
-#define GUID_REGEX                                                                                                     \
-	R"(^([0-9a-fA-F]{8})-([0-9a-fA-F]{4})-([0-9a-fA-F]{4})-([0-9a-fA-F]{2})([0-9a-fA-F]{2})-([0-9a-fA-F]{12})$)"
+// the parser and formatter are usable at compile time, round trip a GUID through both
+static constexpr bool uuid_round_trips(std::string_view str) {
+	GUID uuid = {};
+	if (!parse_uuid(str, &uuid)) { return false; }
+	char text[UUID_STRING_LENGTH] = {};
+	format_uuid(uuid, text);
+	return std::string_view(text, UUID_STRING_LENGTH) == str;
+}
+static_assert(uuid_round_trips("c12a7328-f81f-11d2-ba4b-00a0c93ec93b"));
+static_assert(!uuid_round_trips("C12A7328-F81F-11D2-BA4B-00A0C93EC93B"));
+static_assert(!uuid_round_trips("c12a7328-f81f-11d2-ba4b-00a0c93ec93g"));
+static_assert(!uuid_round_trips("c12a7328-f81f-11d2-ba4b000a0c93ec93b"));
 
-void gen_random_UUIDv4(GUID *uuid) {
-	std::ifstream rnd("/dev/urandom", std::ios::binary);
-	if (!rnd.is_open()) { return; }
-	rnd.read((char *) uuid, sizeof(GUID));
-	rnd.close();
+// bumped in the child after a fork, pools filled before it would otherwise hand out the parent's GUIDs again
+static std::atomic<uint64_t> g_forkGeneration = 0;
 
-	uuid->d3 = (uuid->d3 & UUID_VERSION_MASK) | UUIDv4;
-	uuid->d4[0] = (uuid->d4[0] & UUID_VARIANT_MASK) | UUID_RFC4122;
-}
+struct EntropyPool {
+	uint8_t bytes[UUID_ENTROPY_POOL_SIZE];
+	size_t used = UUID_ENTROPY_POOL_SIZE;
+	uint64_t generation = 0;
 
-#include <iomanip>
-#include <iostream>
+	~EntropyPool() { explicit_bzero(bytes, sizeof(bytes)); }
 
-void print_uuid(const GUID &uuid) {
-	std::ios_base::fmtflags f(std::cout.flags());
+	mdfs::Result refill() {
+		static const bool atforkRegistered = pthread_atfork(nullptr, nullptr, [] { g_forkGeneration++; }) == 0;
+		(void) atforkRegistered;
+		size_t filled = 0;
+		while (filled < sizeof(bytes)) {
+			ssize_t ret = getrandom(bytes + filled, sizeof(bytes) - filled, 0);
+			if (ret < 0 && errno == EINTR) { continue; }
+			if (ret <= 0) { return mdfs::Result::FAILURE; }
+			filled += size_t(ret);
+		}
+		used = 0;
+		generation = g_forkGeneration;
+		return mdfs::Result::SUCCESS;
+	}
 
-	std::cout << std::hex << std::setfill('0') << std::setw(8) << uuid.d1 << "-" << std::setw(4) << uuid.d2 << "-"
-			  << std::setw(4) << uuid.d3 << "-" << std::setw(2) << static_cast<int>(uuid.d4[0]) << std::setw(2)
-			  << static_cast<int>(uuid.d4[1]) << "-" << std::setw(2) << static_cast<int>(uuid.d4[2]) << std::setw(2)
-			  << static_cast<int>(uuid.d4[3]) << std::setw(2) << static_cast<int>(uuid.d4[4]) << std::setw(2)
-			  << static_cast<int>(uuid.d4[5]) << std::setw(2) << static_cast<int>(uuid.d4[6]) << std::setw(2)
-			  << static_cast<int>(uuid.d4[7]) << std::dec << "\n";
+	// copies out length bytes and wipes them from the pool, so they can't be served twice
+	mdfs::Result take(void *out, size_t length) {
+		if (generation != g_forkGeneration) { used = sizeof(bytes); }
+		if (sizeof(bytes) - used < length) {
+			if (refill() != mdfs::Result::SUCCESS) { return mdfs::Result::FAILURE; }
+		}
+		memcpy(out, bytes + used, length);
+		explicit_bzero(bytes + used, length);
+		used += length;
+		return mdfs::Result::SUCCESS;
+	}
+};
+
+static thread_local EntropyPool t_entropyPool;
 
-	std::cout.flags(f);
+mdfs::Result gen_random_UUIDv4(GUID *uuid) { return gen_random_UUIDv4(uuid, 1); }
+
+mdfs::Result gen_random_UUIDv4(GUID *uuids, size_t count) {
+	// several GUIDs are generated aside and copied out together, so a failure part way leaves uuids untouched
+	std::vector<GUID> scratch(count > 1 ? count : 0);
+	GUID *out = count > 1 ? scratch.data() : uuids;
+	for (size_t i = 0; i < count; i++) {
+		GUID uuid;
+		if (t_entropyPool.take(&uuid, sizeof(GUID)) != mdfs::Result::SUCCESS) { return mdfs::Result::FAILURE; }
+		uuid.d3 = (uuid.d3 & UUID_VERSION_MASK) | UUIDv4;
+		uuid.d4[0] = (uuid.d4[0] & UUID_VARIANT_MASK) | UUID_RFC4122;
+		out[i] = uuid;
+	}
+	if (count > 1) { std::copy(scratch.begin(), scratch.end(), uuids); }
+	return mdfs::Result::SUCCESS;
 }
 
+void print_uuid(const GUID &uuid) {
+	char text[UUID_STRING_LENGTH + 1];
+	format_uuid(uuid, std::span<char, UUID_STRING_LENGTH>(text, UUID_STRING_LENGTH));
+	text[UUID_STRING_LENGTH] = '\n';
+	std::cout.write(text, sizeof(text));
+}
 
 bool get_uuid_from_string(const std::string &str, GUID *uuid) {
-	std::regex guid_regex(GUID_REGEX);
-	std::smatch matches;
-
-	if (!std::regex_match(str, matches, guid_regex) || matches.size() < 7) {
+	if (!parse_uuid(str, uuid)) {
 		std::cerr << "Failed to match UUID\n";
 		return false;
 	}
-
-	auto parse_hex = [](const std::string &s) {
-		uint64_t val = 0;
-		std::stringstream ss(s);
-		ss >> std::hex >> val;
-		return val;
-	};
-
-	uuid->d1 = static_cast<uint32_t>(parse_hex(matches[1].str()));
-	uuid->d2 = static_cast<uint16_t>(parse_hex(matches[2].str()));
-	uuid->d3 = static_cast<uint16_t>(parse_hex(matches[3].str()));
-	uuid->d4[0] = static_cast<uint8_t>(parse_hex(matches[4].str()));
-	uuid->d4[1] = static_cast<uint8_t>(parse_hex(matches[5].str()));
-
-	const std::string &lastPart = matches[6].str();
-	for (int i = 0; i < 6; ++i) {
-		std::string byteStr = lastPart.substr(i * 2, 2);
-		uuid->d4[i + 2] = static_cast<uint8_t>(parse_hex(byteStr));
-	}
-
 	return true;
-}
\ No newline at end of file
+}
@@ -0,0 +1,92 @@
+#include <algorithm>
+#include <common/align.hpp>
+#include <common/fstream_engine.hpp>
+#include <common/io_engine.hpp>
+#include <common/mmap_engine.hpp>
+#include <common/posix_engine.hpp>
+#include <common/uring_engine.hpp>
+#include <cstring>
+#include <fcntl.h>
+#include <linux/falloc.h>
+#include <linux/fs.h>
+#include <map>
+#include <stdexcept>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+
+static std::map<std::string, mdfs::IoEngineFactory> &engine_registry() {
+	static std::map<std::string, mdfs::IoEngineFactory> registry = {
+			{"fstream", mdfs::FstreamEngine::create},
+			{"io_uring", mdfs::UringEngine::create},
+			{"mmap", mdfs::MmapEngine::create},
+			{"posix", mdfs::PosixEngine::create},
+	};
+	return registry;
+}
+
+void mdfs::register_io_engine(const std::string &name, IoEngineFactory factory) { engine_registry()[name] = factory; }
+
+std::unique_ptr<mdfs::IoEngine> mdfs::make_io_engine(const IoEngineOptions &options) {
+	auto &registry = engine_registry();
+	auto it = registry.find(options.engine);
+	if (it == registry.end()) { throw std::runtime_error("Unknown I/O engine: " + options.engine); }
+	return it->second(options);
+}
+
+std::vector<std::string> mdfs::io_engine_names() {
+	std::vector<std::string> names;
+	for (const auto &[name, factory] : engine_registry()) { names.push_back(name); }
+	return names;
+}
+
+void mdfs::IoEngine::zero_lba(size_t LBA, size_t sizeInLBA) {
+	size_t bufferSize = mdfs::align_up(zero_buffer_size, m_blockSize);
+	if (m_zeroBufferSize != bufferSize) {
+		m_zeroBuffer = std::make_unique<char[]>(bufferSize);
+		m_zeroBufferSize = bufferSize;
+	}
+	size_t chunkLBA = bufferSize / m_blockSize;
+	while (sizeInLBA > 0) {
+		size_t count = std::min(sizeInLBA, chunkLBA);
+		write_lba(LBA, m_zeroBuffer.get(), count);
+		LBA += count;
+		sizeInLBA -= count;
+	}
+}
+
+mdfs::Result mdfs::zero_range_native(int fd, uint64_t offset, uint64_t length) {
+	struct stat st;
+	if (fstat(fd, &st) != 0) { return Result::FAILURE; }
+
+	if (S_ISBLK(st.st_mode)) {
+		uint64_t range[2] = {offset, length};
+		if (ioctl(fd, BLKZEROOUT, &range) == 0) { return Result::SUCCESS; }
+		// a discard is only usable as a clear if the device guarantees discarded blocks read back as zeros
+		unsigned int discardZeroes = 0;
+		if (ioctl(fd, BLKDISCARDZEROES, &discardZeroes) == 0 && discardZeroes) {
+			if (ioctl(fd, BLKDISCARD, &range) == 0) { return Result::SUCCESS; }
+		}
+		return Result::NO_WORK;
+	}
+
+	if (S_ISREG(st.st_mode)) {
+		if (fallocate(fd, FALLOC_FL_ZERO_RANGE | FALLOC_FL_KEEP_SIZE, offset, length) == 0) { return Result::SUCCESS; }
+		if (fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, offset, length) == 0) { return Result::SUCCESS; }
+	}
+	return Result::NO_WORK;
+}
+
+size_t mdfs::direct_io_alignment(int fd) {
+	struct stat st;
+	if (fstat(fd, &st) == 0 && S_ISBLK(st.st_mode)) {
+		int logicalBlockSize = 0;
+		if (ioctl(fd, BLKSSZGET, &logicalBlockSize) == 0 && logicalBlockSize > 0) { return size_t(logicalBlockSize); }
+	}
+	struct statx stx;
+	if (statx(fd, "", AT_EMPTY_PATH, STATX_DIOALIGN, &stx) == 0 && (stx.stx_mask & STATX_DIOALIGN) &&
+		stx.stx_dio_offset_align != 0) {
+		return std::max(stx.stx_dio_offset_align, stx.stx_dio_mem_align);
+	}
+	// kernels without STATX_DIOALIGN, the page size satisfies every common configuration
+	return 4 * mdfs::units::kb;
+}
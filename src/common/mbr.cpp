@@ -1,7 +1,7 @@
 #include <common/mbr.hpp>
 
 void mdfs::mbr::read_mbr(std::ifstream &file, MBR *mbr) {
-	file.seekg(std::ios::end);
+	file.seekg(0, std::ios::end);
 	if (file.tellg() < sizeof(MBR)) { return; }
 	file.seekg(0);
 	file.read((char *) mbr, sizeof(MBR));
@@ -0,0 +1,111 @@
+#include <common/align.hpp>
+#include <common/mmap_engine.hpp>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <unistd.h>
+
+void mdfs::MmapEngine::open(const std::string &path, size_t blockSize, std::ios_base::openmode openmode) {
+	close();
+	m_blockSize = blockSize;
+	m_writable = openmode & std::ios::out;
+	m_fd = ::open(path.c_str(), (m_writable ? O_RDWR : O_RDONLY) | O_CLOEXEC);
+	if (m_fd < 0) { throw std::runtime_error("Failed to open image"); }
+	off_t end = lseek(m_fd, 0, SEEK_END);
+	if (end < 0) {
+		close();
+		throw std::runtime_error("Failed to open image");
+	}
+	m_fileSize = size_t(end);
+	// an empty image has nothing to map, every transfer on it is out of range anyway
+	if (m_fileSize == 0) { return; }
+
+	void *map = mmap(nullptr, m_fileSize, PROT_READ | (m_writable ? PROT_WRITE : 0), MAP_SHARED, m_fd, 0);
+	if (map == MAP_FAILED) {
+		close();
+		throw std::runtime_error("Failed to map image");
+	}
+	m_map = static_cast<std::byte *>(map);
+}
+
+void mdfs::MmapEngine::close() {
+	if (m_map) {
+		munmap(m_map, m_fileSize);
+		m_map = nullptr;
+	}
+	if (m_fd >= 0) {
+		::close(m_fd);
+		m_fd = -1;
+	}
+	m_fileSize = 0;
+}
+
+void mdfs::MmapEngine::read_lba(size_t LBA, char *data, size_t sizeInLBA) {
+	memcpy(data, m_map + mdfs::lba_to_addr(LBA, m_blockSize), mdfs::lba_to_addr(sizeInLBA, m_blockSize));
+}
+
+void mdfs::MmapEngine::write_lba(size_t LBA, const char *data, size_t sizeInLBA) {
+	memcpy(m_map + mdfs::lba_to_addr(LBA, m_blockSize), data, mdfs::lba_to_addr(sizeInLBA, m_blockSize));
+}
+
+void mdfs::MmapEngine::write_lba_crc(size_t LBA, const char *data, size_t sizeInLBA, Crc32 &crc) {
+	crc.copy_and_update(m_map + mdfs::lba_to_addr(LBA, m_blockSize), data, mdfs::lba_to_addr(sizeInLBA, m_blockSize));
+}
+
+void mdfs::MmapEngine::zero_lba(size_t LBA, size_t sizeInLBA) {
+	// the file system zeroes the page cache pages behind the mapping as well, so the views stay coherent
+	uint64_t offset = mdfs::lba_to_addr(LBA, m_blockSize);
+	size_t length = mdfs::lba_to_addr(sizeInLBA, m_blockSize);
+	if (zero_range_native(m_fd, offset, length) == Result::SUCCESS) { return; }
+	memset(m_map + offset, 0x00, length);
+}
+
+std::span<std::byte> mdfs::MmapEngine::map_lba(size_t LBA, size_t sizeInLBA) {
+	return std::span<std::byte>(m_map + mdfs::lba_to_addr(LBA, m_blockSize), mdfs::lba_to_addr(sizeInLBA, m_blockSize));
+}
+
+std::span<std::byte> mdfs::MmapEngine::page_range(size_t LBA, size_t sizeInLBA) {
+	size_t pageSize = size_t(sysconf(_SC_PAGESIZE));
+	size_t start = mdfs::align_down(mdfs::lba_to_addr(LBA, m_blockSize), pageSize);
+	size_t end = sizeInLBA == 0 ? m_fileSize : mdfs::lba_to_addr(LBA + sizeInLBA, m_blockSize);
+	end = std::min(mdfs::align_up(end, pageSize), mdfs::align_up(m_fileSize, pageSize));
+	if (!m_map || start >= end) { return {}; }
+	return std::span<std::byte>(m_map + start, end - start);
+}
+
+void mdfs::MmapEngine::sync_lba(size_t LBA, size_t sizeInLBA) {
+	std::span<std::byte> range = page_range(LBA, sizeInLBA);
+	if (range.empty() || !m_writable) { return; }
+	if (msync(range.data(), range.size(), MS_SYNC) != 0) { throw std::runtime_error("Failed to sync mapped image"); }
+}
+
+void mdfs::MmapEngine::advise(AccessPattern pattern, size_t LBA, size_t sizeInLBA) {
+	std::span<std::byte> range = page_range(LBA, sizeInLBA);
+	if (range.empty()) { return; }
+	int advice = MADV_NORMAL;
+	switch (pattern) {
+		case AccessPattern::NORMAL:
+			advice = MADV_NORMAL;
+			break;
+		case AccessPattern::SEQUENTIAL:
+			advice = MADV_SEQUENTIAL;
+			break;
+		case AccessPattern::RANDOM:
+			advice = MADV_RANDOM;
+			break;
+		case AccessPattern::WILL_NEED:
+			advice = MADV_WILLNEED;
+			break;
+		case AccessPattern::DONT_NEED:
+			advice = MADV_DONTNEED;
+			break;
+	}
+	// purely a hint, failure changes nothing about correctness
+	madvise(range.data(), range.size(), advice);
+}
+
+std::unique_ptr<mdfs::IoEngine> mdfs::MmapEngine::create(const IoEngineOptions &options) {
+	if (options.direct) { throw std::runtime_error("The mmap engine doesn't support direct I/O"); }
+	return std::make_unique<MmapEngine>();
+}
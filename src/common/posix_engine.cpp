@@ -0,0 +1,235 @@
+#include <algorithm>
+#include <cerrno>
+#include <common/align.hpp>
+#include <common/posix_engine.hpp>
+#include <cstring>
+#include <climits>
+#include <fcntl.h>
+#include <stdexcept>
+#include <unistd.h>
+
+mdfs::PosixEngine::PosixEngine(const IoEngineOptions &options) : m_options(options) {
+	m_options.queueDepth = std::clamp<size_t>(m_options.queueDepth, 1, 4096);
+	m_options.requestSize = std::max<size_t>(m_options.requestSize, 4 * mdfs::units::kb);
+}
+
+void mdfs::PosixEngine::open(const std::string &path, size_t blockSize, std::ios_base::openmode openmode) {
+	close();
+	m_blockSize = blockSize;
+	// requests never split a sector
+	m_options.requestSize = mdfs::align_up(m_options.requestSize, m_blockSize);
+	int flags = ((openmode & std::ios::out) ? O_RDWR : O_RDONLY) | O_CLOEXEC;
+	if (m_options.direct) { flags |= O_DIRECT; }
+	m_fd = ::open(path.c_str(), flags);
+	if (m_fd < 0) { throw std::runtime_error("Failed to open image"); }
+	off_t end = lseek(m_fd, 0, SEEK_END);
+	if (end < 0) {
+		close();
+		throw std::runtime_error("Failed to open image");
+	}
+	m_fileSize = size_t(end);
+
+	m_bufferAlignment = 4 * mdfs::units::kb;
+	if (m_options.direct) {
+		m_alignment = mdfs::direct_io_alignment(m_fd);
+		m_bufferAlignment = std::max(m_bufferAlignment, m_alignment);
+		// writing back the last block of an image that ends mid block would grow it
+		if (m_fileSize % m_alignment != 0) {
+			close();
+			throw std::runtime_error("Image size is not a multiple of the direct I/O alignment");
+		}
+		m_options.requestSize = mdfs::align_up(m_options.requestSize, m_alignment);
+	}
+
+	m_pool.allocate(m_options.queueDepth, m_options.requestSize, m_bufferAlignment);
+	m_zeros.allocate(1, m_options.requestSize, m_bufferAlignment);
+	memset(m_zeros.buffer(0), 0x00, m_zeros.buffer_size());
+}
+
+void mdfs::PosixEngine::close() {
+	if (m_fd >= 0) {
+		::close(m_fd);
+		m_fd = -1;
+	}
+	m_pool.allocate(0, 0, 1);
+	m_zeros.allocate(0, 0, 1);
+	m_alignment = 1;
+	m_fileSize = 0;
+	m_completedBytes = 0;
+}
+
+void mdfs::PosixEngine::read_lba(size_t LBA, char *data, size_t sizeInLBA) {
+	transfer(Op::READ, mdfs::lba_to_addr(LBA, m_blockSize), data, mdfs::lba_to_addr(sizeInLBA, m_blockSize));
+}
+
+void mdfs::PosixEngine::write_lba(size_t LBA, const char *data, size_t sizeInLBA) {
+	transfer(Op::WRITE, mdfs::lba_to_addr(LBA, m_blockSize), const_cast<char *>(data),
+			 mdfs::lba_to_addr(sizeInLBA, m_blockSize));
+}
+
+void mdfs::PosixEngine::write_lba_crc(size_t LBA, const char *data, size_t sizeInLBA, Crc32 &crc) {
+	transfer(Op::WRITE, mdfs::lba_to_addr(LBA, m_blockSize), const_cast<char *>(data),
+			 mdfs::lba_to_addr(sizeInLBA, m_blockSize), &crc);
+}
+
+void mdfs::PosixEngine::write_batch(std::span<const IoExtent> extents) {
+	// O_DIRECT needs every buffer aligned, which the caller's rarely are, so they take the bouncing path
+	if (m_options.direct) {
+		IoEngine::write_batch(extents);
+		return;
+	}
+	size_t i = 0;
+	while (i < extents.size()) {
+		std::vector<iovec> iov;
+		size_t nextLBA = extents[i].LBA;
+		size_t first = i;
+		while (i < extents.size() && extents[i].LBA == nextLBA && iov.size() < IOV_MAX) {
+			iov.push_back({.iov_base = const_cast<char *>(extents[i].data),
+						   .iov_len = mdfs::lba_to_addr(extents[i].sizeInLBA, m_blockSize)});
+			nextLBA += extents[i].sizeInLBA;
+			i++;
+		}
+		pwritev_all(mdfs::lba_to_addr(extents[first].LBA, m_blockSize), std::move(iov));
+	}
+}
+
+void mdfs::PosixEngine::pwritev_all(uint64_t offset, std::vector<iovec> iov, size_t skip) {
+	size_t index = 0;
+	while (index < iov.size()) {
+		// drop whatever was already written from the front of the vector
+		while (index < iov.size() && skip >= iov[index].iov_len) {
+			skip -= iov[index].iov_len;
+			offset += iov[index].iov_len;
+			index++;
+		}
+		if (index == iov.size()) { break; }
+		iov[index].iov_base = static_cast<char *>(iov[index].iov_base) + skip;
+		iov[index].iov_len -= skip;
+		offset += skip;
+		ssize_t ret = pwritev(m_fd, iov.data() + index, int(iov.size() - index), off_t(offset));
+		if (ret < 0 && errno == EINTR) {
+			skip = 0;
+			continue;
+		}
+		if (ret <= 0) { throw std::runtime_error(std::string("I/O error: ") + strerror(ret < 0 ? errno : EIO)); }
+		report(size_t(ret));
+		skip = size_t(ret);
+	}
+}
+
+void mdfs::PosixEngine::zero_lba(size_t LBA, size_t sizeInLBA) {
+	uint64_t offset = mdfs::lba_to_addr(LBA, m_blockSize);
+	size_t length = mdfs::lba_to_addr(sizeInLBA, m_blockSize);
+	if (zero_range_native(m_fd, offset, length) == Result::SUCCESS) {
+		report(length);
+		return;
+	}
+	transfer(Op::ZERO, offset, nullptr, length);
+}
+
+void mdfs::PosixEngine::sync_lba(size_t /*LBA*/, size_t /*sizeInLBA*/) {
+	if (fdatasync(m_fd) != 0) { throw std::runtime_error(std::string("Failed to sync image: ") + strerror(errno)); }
+}
+
+void mdfs::PosixEngine::report(size_t bytes) {
+	uint64_t total = m_completedBytes.fetch_add(bytes) + bytes;
+	if (m_options.progress) { m_options.progress(total); }
+}
+
+void mdfs::PosixEngine::transfer(Op op, uint64_t offset, char *data, size_t length, Crc32 *crc) {
+	if (length == 0) { return; }
+	uint64_t alignedStart = mdfs::align_up<uint64_t>(offset, m_alignment);
+	uint64_t alignedEnd = mdfs::align_down<uint64_t>(offset + length, m_alignment);
+	if (alignedStart >= alignedEnd) {
+		// the whole range sits inside one or two alignment blocks
+		while (length > 0) {
+			size_t chunk = std::min<size_t>(length, mdfs::align_down<uint64_t>(offset, m_alignment) + m_alignment - offset);
+			transfer_edge(op, offset, data, chunk, crc);
+			offset += chunk;
+			data = data ? data + chunk : nullptr;
+			length -= chunk;
+		}
+		return;
+	}
+	if (alignedStart != offset) { transfer_edge(op, offset, data, alignedStart - offset, crc); }
+	transfer_aligned(op, alignedStart, data ? data + (alignedStart - offset) : nullptr, alignedEnd - alignedStart,
+					 crc);
+	if (alignedEnd != offset + length) {
+		transfer_edge(op, alignedEnd, data ? data + (alignedEnd - offset) : nullptr, offset + length - alignedEnd,
+					  crc);
+	}
+}
+
+void mdfs::PosixEngine::transfer_edge(Op op, uint64_t offset, char *data, size_t length, Crc32 *crc) {
+	uint64_t block = mdfs::align_down<uint64_t>(offset, m_alignment);
+	size_t index = m_pool.acquire();
+	char *edge = m_pool.buffer(index);
+	try {
+		transfer_aligned(Op::READ, block, edge, m_alignment);
+		if (op == Op::READ) {
+			memcpy(data, edge + (offset - block), length);
+		} else {
+			if (op == Op::WRITE && crc) {
+				crc->copy_and_update(edge + (offset - block), data, length);
+			} else if (op == Op::WRITE) {
+				memcpy(edge + (offset - block), data, length);
+			} else {
+				memset(edge + (offset - block), 0x00, length);
+			}
+			transfer_aligned(Op::WRITE, block, edge, m_alignment);
+		}
+	} catch (...) {
+		m_pool.release(index);
+		throw;
+	}
+	m_pool.release(index);
+}
+
+void mdfs::PosixEngine::transfer_aligned(Op op, uint64_t offset, char *data, size_t length, Crc32 *crc) {
+	// with O_DIRECT the caller's memory can only be handed to the kernel if it happens to be aligned, everything
+	// else is bounced through the pool. pool buffers and the zero buffer are aligned, so edges never nest acquires
+	bool bounce = m_options.direct && op != Op::ZERO && (uintptr_t(data) % m_alignment) != 0;
+	size_t index = bounce ? m_pool.acquire() : 0;
+	char *buffer = bounce ? m_pool.buffer(index) : nullptr;
+	// the caller's buffer goes to the kernel as is, so there is no copy to fold the checksum into
+	if (crc && op == Op::WRITE && !bounce) { crc->update(data, length); }
+	size_t done = 0;
+	size_t checksummed = 0;
+	int error = 0;
+	while (done < length) {
+		size_t chunk = (bounce || op == Op::ZERO) ? std::min(m_options.requestSize, length - done) : length - done;
+		const char *source = (op == Op::ZERO) ? m_zeros.buffer(0) : data + done;
+		if (bounce && op == Op::WRITE) {
+			// after a short write part of the chunk is copied again, only the new bytes go into the checksum
+			size_t seen = std::min(checksummed - done, chunk);
+			if (crc && seen < chunk) {
+				memcpy(buffer, source, seen);
+				crc->copy_and_update(buffer + seen, source + seen, chunk - seen);
+				checksummed = done + chunk;
+			} else {
+				memcpy(buffer, source, chunk);
+			}
+			source = buffer;
+		}
+		ssize_t ret;
+		if (op == Op::READ) {
+			ret = pread(m_fd, bounce ? buffer : data + done, chunk, off_t(offset + done));
+		} else {
+			ret = pwrite(m_fd, source, chunk, off_t(offset + done));
+		}
+		if (ret < 0 && errno == EINTR) { continue; }
+		if (ret <= 0) {
+			error = (ret < 0) ? errno : EIO;
+			break;
+		}
+		if (bounce && op == Op::READ) { memcpy(data + done, buffer, size_t(ret)); }
+		done += size_t(ret);
+		report(size_t(ret));
+	}
+	if (bounce) { m_pool.release(index); }
+	if (error != 0) { throw std::runtime_error(std::string("I/O error: ") + strerror(error)); }
+}
+
+std::unique_ptr<mdfs::IoEngine> mdfs::PosixEngine::create(const IoEngineOptions &options) {
+	return std::make_unique<PosixEngine>(options);
+}
@@ -0,0 +1,133 @@
+#include <algorithm>
+#include <cerrno>
+#include <common/stream_writer.hpp>
+#include <common/util.hpp>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <string>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+// pipes only hold references to the pages that are spliced into them, the buffer is never written so every splice
+// can share it
+alignas(4096) static const char g_zeros[1048576] = {};
+
+mdfs::StreamWriter::StreamWriter(int fd, size_t chunkSize) : m_fd(fd), m_chunkSize(std::max<size_t>(chunkSize, 4096)) {
+	struct stat st;
+	if (fstat(fd, &st) != 0) { throw_errno("Failed to stat the output"); }
+	m_pipe = S_ISFIFO(st.st_mode);
+	// holes are only safe while nothing is behind the write position, and appending ignores the position anyway
+	off_t position = lseek(fd, 0, SEEK_CUR);
+	int flags = fcntl(fd, F_GETFL);
+	m_holes = S_ISREG(st.st_mode) && position >= 0 && position >= st.st_size && flags >= 0 && !(flags & O_APPEND);
+	m_start = m_holes ? uint64_t(position) : 0;
+}
+
+void mdfs::StreamWriter::write_fully(const void *data, size_t size) {
+	const char *bytes = static_cast<const char *>(data);
+	while (size > 0) {
+		ssize_t written = ::write(m_fd, bytes, std::min(size, m_chunkSize));
+		if (written < 0) {
+			if (errno == EINTR) { continue; }
+			throw_errno("Failed to write the image");
+		}
+		bytes += written;
+		size -= size_t(written);
+		m_offset += uint64_t(written);
+	}
+}
+
+void mdfs::StreamWriter::flush_hole() {
+	if (m_pendingHole == 0) { return; }
+	if (lseek(m_fd, off_t(m_pendingHole), SEEK_CUR) < 0) { throw_errno("Failed to seek in the image"); }
+	m_offset += m_pendingHole;
+	m_pendingHole = 0;
+}
+
+void mdfs::StreamWriter::write(const void *data, size_t size) {
+	flush_hole();
+	write_fully(data, size);
+}
+
+size_t mdfs::StreamWriter::splice_zeros(size_t size) {
+	iovec iov = {.iov_base = const_cast<char *>(g_zeros), .iov_len = size};
+	ssize_t spliced = vmsplice(m_fd, &iov, 1, 0);
+	if (spliced >= 0) {
+		m_offset += uint64_t(spliced);
+		return size_t(spliced);
+	}
+	if (errno == EINVAL || errno == ENOSYS) {
+		m_useSplice = false;
+	} else if (errno != EINTR) {
+		throw_errno("Failed to write the image");
+	}
+	return 0;
+}
+
+void mdfs::StreamWriter::write_zeros(uint64_t size) {
+	if (m_holes) {
+		m_pendingHole += size;
+		return;
+	}
+	while (size > 0) {
+		size_t chunk = size_t(std::min<uint64_t>(size, sizeof(g_zeros)));
+		if (m_pipe && m_useSplice) {
+			size -= splice_zeros(chunk);
+			continue;
+		}
+		chunk = std::min(chunk, m_chunkSize);
+		write_fully(g_zeros, chunk);
+		size -= chunk;
+	}
+}
+
+void mdfs::StreamWriter::write_file(int fd, uint64_t offset, uint64_t size) {
+	flush_hole();
+	while (size > 0) {
+		size_t chunk = size_t(std::min<uint64_t>(size, m_chunkSize));
+		off_t in = off_t(offset);
+		ssize_t moved;
+		if (m_pipe && m_useSplice) {
+			moved = splice(fd, &in, m_fd, nullptr, chunk, SPLICE_F_MORE);
+			// the source doesn't support splicing
+			if (moved < 0 && errno == EINVAL) {
+				m_useSplice = false;
+				continue;
+			}
+		} else if (!m_pipe && m_useCopyRange) {
+			moved = copy_file_range(fd, &in, m_fd, nullptr, chunk, 0);
+			// EBADF is what an output opened with O_APPEND gets
+			if (moved < 0 && (errno == EXDEV || errno == EINVAL || errno == ENOSYS || errno == EOPNOTSUPP ||
+							 errno == EBADF)) {
+				m_useCopyRange = false;
+				continue;
+			}
+		} else {
+			if (m_buffer.empty()) { m_buffer.resize(m_chunkSize); }
+			moved = pread(fd, m_buffer.data(), chunk, in);
+			if (moved > 0) {
+				write_fully(m_buffer.data(), size_t(moved));
+				offset += uint64_t(moved);
+				size -= uint64_t(moved);
+				continue;
+			}
+		}
+		if (moved == 0) { throw std::runtime_error("Source file ended early"); }
+		if (moved < 0) {
+			if (errno == EINTR) { continue; }
+			throw_errno("Failed to copy a source file");
+		}
+		offset += uint64_t(moved);
+		size -= uint64_t(moved);
+		m_offset += uint64_t(moved);
+	}
+}
+
+void mdfs::StreamWriter::finish() {
+	if (m_pendingHole == 0) { return; }
+	m_offset += m_pendingHole;
+	m_pendingHole = 0;
+	if (ftruncate(m_fd, off_t(m_start + m_offset)) != 0) { throw_errno("Failed to extend the image"); }
+}
@@ -0,0 +1,173 @@
+#include <common/crc32.hpp>
+#include <common/table_reader.hpp>
+#include <cstddef>
+#include <cstring>
+
+const char *mdfs::gpt_status_name(GptStatus status) {
+	switch (status) {
+		case GptStatus::VALID:
+			return "valid";
+		case GptStatus::OUT_OF_RANGE:
+			return "out of range";
+		case GptStatus::BAD_SIGNATURE:
+			return "bad signature";
+		case GptStatus::BAD_HEADER:
+			return "bad header";
+		case GptStatus::BAD_HEADER_CRC:
+			return "bad header CRC";
+		case GptStatus::BAD_ENTRIES:
+			return "bad entry array";
+		case GptStatus::BAD_ENTRIES_CRC:
+			return "bad entry array CRC";
+		default:
+			return "unknown";
+	}
+}
+
+uint32_t mdfs::GptEntryRange::next_used(uint32_t index) const {
+	for (; index < m_count; index++) {
+		// an unused entry has an all zero type GUID, checked as two 64 bit words
+		uint64_t words[2];
+		memcpy(words, m_entries.data() + size_t(index) * m_stride, sizeof(words));
+		if ((words[0] | words[1]) != 0) { break; }
+	}
+	return index;
+}
+
+mdfs::GptEntryRange mdfs::GptCopy::used_entries() const {
+	if (!valid()) { return GptEntryRange(); }
+	return GptEntryRange(entries, header->numberOfPartitionEntries, header->sizeOfPartitionEntries);
+}
+
+mdfs::Result mdfs::PartitionTableReader::read() {
+	m_primary = GptCopy();
+	m_backup = GptCopy();
+	if (m_disk.size_b() < sizeof(mbr::MBR)) { return Result::FAILURE; }
+	m_disk.read_at(0, &m_mbr, sizeof(mbr::MBR));
+
+	read_copy(1, m_primary, m_primaryHeader, m_primaryEntries);
+	size_t backupLBA = m_primary.valid() ? m_primary.header->alternateLBA : m_disk.size_lba() - 1;
+	read_copy(backupLBA, m_backup, m_backupHeader, m_backupEntries);
+	return Result::SUCCESS;
+}
+
+mdfs::Result mdfs::PartitionTableReader::read_detecting_sector_size() {
+	m_disk.set_block_size(512);
+	Result result = read();
+	// 4K native images keep the GPT header at byte 4096
+	if (result != Result::SUCCESS || m_primary.valid() || m_disk.size_b() < 2 * 4096) { return result; }
+	m_disk.set_block_size(4096);
+	if (read() == Result::SUCCESS && m_primary.valid()) { return Result::SUCCESS; }
+	m_disk.set_block_size(512);
+	return read();
+}
+
+bool mdfs::PartitionTableReader::has_protective_mbr() const {
+	if (!has_mbr_signature()) { return false; }
+	size_t protective = 0;
+	for (const mbr::PartitionRecord &record : m_mbr.partitionRecords) {
+		if (record.OSType == 0xEE && record.startingLBA == 1) {
+			protective++;
+		} else if (record.OSType != 0x00) {
+			return false;
+		}
+	}
+	return protective == 1;
+}
+
+const mdfs::GptCopy *mdfs::PartitionTableReader::active() const {
+	if (m_primary.valid()) { return &m_primary; }
+	if (m_backup.valid()) { return &m_backup; }
+	return nullptr;
+}
+
+std::span<const std::byte> mdfs::PartitionTableReader::load(size_t LBA, size_t sizeInLBA,
+															 std::vector<std::byte> &buffer) {
+	std::span<std::byte> mapped = m_disk.engine()->map_lba(LBA, sizeInLBA);
+	if (mapped.size() == mdfs::lba_to_addr(sizeInLBA, m_disk.block_size())) { return mapped; }
+	buffer.resize(mdfs::lba_to_addr(sizeInLBA, m_disk.block_size()));
+	m_disk.read_lba(LBA, reinterpret_cast<char *>(buffer.data()), sizeInLBA);
+	return buffer;
+}
+
+void mdfs::PartitionTableReader::read_copy(size_t LBA, GptCopy &copy, std::vector<std::byte> &headerBuffer,
+										   std::vector<std::byte> &entryBuffer) {
+	copy.headerLBA = LBA;
+	if (LBA == 0 || LBA >= m_disk.size_lba()) {
+		copy.status = GptStatus::OUT_OF_RANGE;
+		return;
+	}
+
+	std::span<const std::byte> sector = load(LBA, 1, headerBuffer);
+	const HeaderGPT *header = reinterpret_cast<const HeaderGPT *>(sector.data());
+	copy.header = header;
+	if (header->signature != GPT_SIGNATURE) {
+		copy.status = GptStatus::BAD_SIGNATURE;
+		return;
+	}
+	if (header->headerSize < sizeof(HeaderGPT) || header->headerSize > sector.size() || header->myLBA != LBA) {
+		copy.status = GptStatus::BAD_HEADER;
+		return;
+	}
+
+	// the CRC covers headerSize bytes with the CRC field itself taken as zero
+	size_t crcOffset = offsetof(HeaderGPT, headerCRC32);
+	Crc32 headerCRC;
+	headerCRC.update(sector.data(), crcOffset).update_zeros(sizeof(crc32_t));
+	headerCRC.update(sector.data() + crcOffset + sizeof(crc32_t), header->headerSize - crcOffset - sizeof(crc32_t));
+	if (headerCRC.finalize() != header->headerCRC32) {
+		copy.status = GptStatus::BAD_HEADER_CRC;
+		return;
+	}
+
+	// entries are 128 << n bytes, and the array has to fit in the image without overlapping LBA 0 or the header
+	uint32_t stride = header->sizeOfPartitionEntries;
+	uint64_t entryBytes = uint64_t(header->numberOfPartitionEntries) * stride;
+	uint64_t entryLBAs = mdfs::align_up<uint64_t>(entryBytes, m_disk.block_size()) / m_disk.block_size();
+	if (stride < sizeof(PartitionEntryGPT) || (stride & (stride - 1)) != 0 || header->partitionEntryLBA == 0 ||
+		header->partitionEntryLBA > m_disk.size_lba() || entryLBAs > m_disk.size_lba() - header->partitionEntryLBA ||
+		(header->partitionEntryLBA <= LBA && LBA < header->partitionEntryLBA + entryLBAs)) {
+		copy.status = GptStatus::BAD_ENTRIES;
+		return;
+	}
+
+	copy.entries = load(header->partitionEntryLBA, entryLBAs, entryBuffer).first(entryBytes);
+	if (crc32(copy.entries.data(), copy.entries.size()) != header->partitionEntryArrayCRC32) {
+		copy.status = GptStatus::BAD_ENTRIES_CRC;
+		return;
+	}
+	copy.status = GptStatus::VALID;
+}
+
+std::string mdfs::gpt_partition_name(const PartitionEntryGPT &entry) {
+	std::string name;
+	const size_t length = sizeof(entry.partitionName) / sizeof(char16_t);
+	for (size_t i = 0; i < length; i++) {
+		uint32_t code = entry.partitionName[i];
+		if (code == 0) { break; }
+		if (code >= 0xD800 && code < 0xDC00 && i + 1 < length && entry.partitionName[i + 1] >= 0xDC00 &&
+			entry.partitionName[i + 1] < 0xE000) {
+			code = 0x10000 + ((code - 0xD800) << 10) + (entry.partitionName[++i] - 0xDC00);
+		} else if (code >= 0xD800 && code < 0xE000) {
+			// unpaired surrogate
+			code = 0xFFFD;
+		}
+
+		if (code < 0x80) {
+			name.push_back(char(code));
+		} else if (code < 0x800) {
+			name.push_back(char(0xC0 | (code >> 6)));
+			name.push_back(char(0x80 | (code & 0x3F)));
+		} else if (code < 0x10000) {
+			name.push_back(char(0xE0 | (code >> 12)));
+			name.push_back(char(0x80 | ((code >> 6) & 0x3F)));
+			name.push_back(char(0x80 | (code & 0x3F)));
+		} else {
+			name.push_back(char(0xF0 | (code >> 18)));
+			name.push_back(char(0x80 | ((code >> 12) & 0x3F)));
+			name.push_back(char(0x80 | ((code >> 6) & 0x3F)));
+			name.push_back(char(0x80 | (code & 0x3F)));
+		}
+	}
+	return name;
+}
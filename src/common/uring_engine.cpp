@@ -0,0 +1,289 @@
+#include <algorithm>
+#include <cerrno>
+#include <common/align.hpp>
+#include <common/uring_engine.hpp>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+static int io_uring_setup(unsigned entries, io_uring_params *params) {
+	return int(syscall(__NR_io_uring_setup, entries, params));
+}
+
+static int io_uring_enter(int ringFd, unsigned toSubmit, unsigned minComplete, unsigned flags) {
+	return int(syscall(__NR_io_uring_enter, ringFd, toSubmit, minComplete, flags, nullptr, 0));
+}
+
+static int io_uring_register(int ringFd, unsigned opcode, const void *arg, unsigned nrArgs) {
+	return int(syscall(__NR_io_uring_register, ringFd, opcode, arg, nrArgs));
+}
+
+void mdfs::UringEngine::open(const std::string &path, size_t blockSize, std::ios_base::openmode openmode) {
+	close();
+	PosixEngine::open(path, blockSize, openmode);
+	m_slotBuffers.allocate(m_options.queueDepth, m_options.requestSize, m_bufferAlignment);
+	m_slots.assign(m_options.queueDepth, Slot());
+	if (!setup_ring()) { teardown_ring(); }
+}
+
+void mdfs::UringEngine::close() {
+	teardown_ring();
+	m_slotBuffers.allocate(0, 0, 1);
+	m_slots.clear();
+	PosixEngine::close();
+}
+
+bool mdfs::UringEngine::setup_ring() {
+	io_uring_params params;
+	memset(&params, 0, sizeof(params));
+	m_ringFd = io_uring_setup(unsigned(m_options.queueDepth), &params);
+	if (m_ringFd < 0) { return false; }
+
+	m_sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+	m_cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+	bool singleMmap = params.features & IORING_FEAT_SINGLE_MMAP;
+	if (singleMmap) { m_sqRingSize = m_cqRingSize = std::max(m_sqRingSize, m_cqRingSize); }
+
+	m_sqRing = mmap(nullptr, m_sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ringFd,
+					IORING_OFF_SQ_RING);
+	if (m_sqRing == MAP_FAILED) {
+		m_sqRing = nullptr;
+		return false;
+	}
+	if (singleMmap) {
+		m_cqRing = m_sqRing;
+	} else {
+		m_cqRing = mmap(nullptr, m_cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ringFd,
+						IORING_OFF_CQ_RING);
+		if (m_cqRing == MAP_FAILED) {
+			m_cqRing = nullptr;
+			return false;
+		}
+	}
+	m_sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+	void *sqes = mmap(nullptr, m_sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ringFd,
+					  IORING_OFF_SQES);
+	if (sqes == MAP_FAILED) { return false; }
+	m_sqes = static_cast<io_uring_sqe *>(sqes);
+
+	char *sq = static_cast<char *>(m_sqRing);
+	m_sqHead = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+	m_sqTail = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+	m_sqMask = reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+	m_sqArray = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+	char *cq = static_cast<char *>(m_cqRing);
+	m_cqHead = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+	m_cqTail = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+	m_cqMask = reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+	m_cqes = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+
+	// registered buffers save the kernel from pinning pages on every request, but they count against
+	// RLIMIT_MEMLOCK, so plain READ/WRITE on the same buffers is used if the registration is refused
+	std::vector<iovec> iovecs(m_slotBuffers.count() + 1);
+	for (size_t i = 0; i < m_slotBuffers.count(); i++) {
+		iovecs[i] = {.iov_base = m_slotBuffers.buffer(i), .iov_len = m_slotBuffers.buffer_size()};
+	}
+	iovecs.back() = {.iov_base = m_zeros.buffer(0), .iov_len = m_zeros.buffer_size()};
+	m_fixedBuffers =
+			io_uring_register(m_ringFd, IORING_REGISTER_BUFFERS, iovecs.data(), unsigned(iovecs.size())) == 0;
+	m_pending = 0;
+	return true;
+}
+
+void mdfs::UringEngine::teardown_ring() {
+	if (m_sqes) { munmap(m_sqes, m_sqesSize); }
+	if (m_cqRing && m_cqRing != m_sqRing) { munmap(m_cqRing, m_cqRingSize); }
+	if (m_sqRing) { munmap(m_sqRing, m_sqRingSize); }
+	if (m_ringFd >= 0) { ::close(m_ringFd); }
+	m_sqes = nullptr;
+	m_sqRing = nullptr;
+	m_cqRing = nullptr;
+	m_ringFd = -1;
+	m_fixedBuffers = false;
+}
+
+void mdfs::UringEngine::queue_slot(Op op, unsigned index) {
+	Slot &slot = m_slots[index];
+	unsigned bufferIndex = (op == Op::ZERO) ? unsigned(m_slotBuffers.count()) : index;
+	char *buffer = (op == Op::ZERO) ? m_zeros.buffer(0) : m_slotBuffers.buffer(index);
+
+	unsigned tail = *m_sqTail;
+	io_uring_sqe *sqe = next_sqe(tail);
+	if (m_fixedBuffers) {
+		sqe->opcode = (op == Op::READ) ? IORING_OP_READ_FIXED : IORING_OP_WRITE_FIXED;
+		sqe->buf_index = uint16_t(bufferIndex);
+	} else {
+		sqe->opcode = (op == Op::READ) ? IORING_OP_READ : IORING_OP_WRITE;
+	}
+	sqe->fd = m_fd;
+	sqe->off = slot.offset + slot.done;
+	sqe->addr = uint64_t(uintptr_t(buffer + slot.done));
+	sqe->len = uint32_t(slot.length - slot.done);
+	sqe->user_data = index;
+	commit_sqe(tail);
+}
+
+io_uring_sqe *mdfs::UringEngine::next_sqe(unsigned tail) {
+	io_uring_sqe *sqe = &m_sqes[tail & *m_sqMask];
+	memset(sqe, 0, sizeof(io_uring_sqe));
+	return sqe;
+}
+
+void mdfs::UringEngine::commit_sqe(unsigned tail) {
+	unsigned sqIndex = tail & *m_sqMask;
+	m_sqArray[sqIndex] = sqIndex;
+	__atomic_store_n(m_sqTail, tail + 1, __ATOMIC_RELEASE);
+	m_pending++;
+}
+
+void mdfs::UringEngine::write_batch(std::span<const IoExtent> extents) {
+	if (m_ringFd < 0 || m_options.direct) {
+		PosixEngine::write_batch(extents);
+		return;
+	}
+
+	// adjacent extents become one WRITEV straight from the caller's buffers
+	struct Run {
+		uint64_t offset;
+		size_t length = 0;
+		std::vector<iovec> iov = {};
+	};
+	std::vector<Run> runs;
+	for (const IoExtent &extent : extents) {
+		uint64_t offset = mdfs::lba_to_addr(extent.LBA, m_blockSize);
+		size_t length = mdfs::lba_to_addr(extent.sizeInLBA, m_blockSize);
+		if (runs.empty() || runs.back().offset + runs.back().length != offset || runs.back().iov.size() >= IOV_MAX) {
+			runs.push_back({.offset = offset});
+		}
+		runs.back().iov.push_back({.iov_base = const_cast<char *>(extent.data), .iov_len = length});
+		runs.back().length += length;
+	}
+
+	int error = 0;
+	for (size_t next = 0; next < runs.size();) {
+		// every run of this round goes out with a single io_uring_enter
+		unsigned count = unsigned(std::min(runs.size() - next, m_slots.size()));
+		for (unsigned i = 0; i < count; i++) {
+			const Run &run = runs[next + i];
+			unsigned tail = *m_sqTail;
+			io_uring_sqe *sqe = next_sqe(tail);
+			sqe->opcode = IORING_OP_WRITEV;
+			sqe->fd = m_fd;
+			sqe->off = run.offset;
+			sqe->addr = uint64_t(uintptr_t(run.iov.data()));
+			sqe->len = uint32_t(run.iov.size());
+			sqe->user_data = next + i;
+			commit_sqe(tail);
+		}
+
+		unsigned reaped = 0;
+		while (reaped < count) {
+			int ret = io_uring_enter(m_ringFd, m_pending, count - reaped, IORING_ENTER_GETEVENTS);
+			if (ret < 0) {
+				if (errno == EINTR || errno == EAGAIN || errno == EBUSY) { continue; }
+				throw std::runtime_error(std::string("io_uring_enter failed: ") + strerror(errno));
+			}
+			m_pending -= std::min<unsigned>(m_pending, unsigned(ret));
+
+			unsigned head = *m_cqHead;
+			unsigned tail = __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE);
+			for (; head != tail; head++, reaped++) {
+				const io_uring_cqe &cqe = m_cqes[head & *m_cqMask];
+				const Run &run = runs[size_t(cqe.user_data)];
+				if (cqe.res < 0 && cqe.res != -EINTR && cqe.res != -EAGAIN) {
+					if (error == 0) { error = -cqe.res; }
+					continue;
+				}
+				size_t written = cqe.res < 0 ? 0 : size_t(cqe.res);
+				report(written);
+				// short or interrupted writes are rare, the remainder is finished synchronously
+				if (written < run.length) { pwritev_all(run.offset, run.iov, written); }
+			}
+			__atomic_store_n(m_cqHead, head, __ATOMIC_RELEASE);
+		}
+		next += count;
+	}
+
+	if (error != 0) { throw std::runtime_error(std::string("I/O error: ") + strerror(error)); }
+}
+
+void mdfs::UringEngine::transfer_aligned(Op op, uint64_t offset, char *data, size_t length, Crc32 *crc) {
+	if (m_ringFd < 0) {
+		PosixEngine::transfer_aligned(op, offset, data, length, crc);
+		return;
+	}
+
+	size_t issued = 0;
+	size_t inFlight = 0;
+	int error = 0;
+	while ((issued < length && error == 0) || inFlight > 0) {
+		// keep every free slot busy
+		for (unsigned i = 0; i < m_slots.size() && issued < length && error == 0; i++) {
+			Slot &slot = m_slots[i];
+			if (slot.busy) { continue; }
+			slot = {.busy = true,
+					.offset = offset + issued,
+					.length = std::min(m_options.requestSize, length - issued),
+					.done = 0,
+					.user = data ? data + issued : nullptr};
+			// slots are filled in file order, so the checksum sees the data in order too
+			if (op == Op::WRITE && crc) {
+				crc->copy_and_update(m_slotBuffers.buffer(i), slot.user, slot.length);
+			} else if (op == Op::WRITE) {
+				memcpy(m_slotBuffers.buffer(i), slot.user, slot.length);
+			}
+			queue_slot(op, i);
+			issued += slot.length;
+			inFlight++;
+		}
+
+		int ret = io_uring_enter(m_ringFd, m_pending, 1, IORING_ENTER_GETEVENTS);
+		if (ret < 0) {
+			if (errno == EINTR || errno == EAGAIN || errno == EBUSY) { continue; }
+			// the ring is unusable, nothing is left in flight that could still touch the buffers
+			throw std::runtime_error(std::string("io_uring_enter failed: ") + strerror(errno));
+		}
+		m_pending -= std::min<unsigned>(m_pending, unsigned(ret));
+
+		unsigned head = *m_cqHead;
+		unsigned tail = __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE);
+		for (; head != tail; head++) {
+			const io_uring_cqe &cqe = m_cqes[head & *m_cqMask];
+			unsigned index = unsigned(cqe.user_data);
+			Slot &slot = m_slots[index];
+			if (cqe.res == -EINTR || cqe.res == -EAGAIN) {
+				queue_slot(op, index);
+				continue;
+			}
+			if (cqe.res <= 0) {
+				if (error == 0) { error = cqe.res < 0 ? -cqe.res : EIO; }
+				slot.busy = false;
+				inFlight--;
+				continue;
+			}
+			slot.done += size_t(cqe.res);
+			report(size_t(cqe.res));
+			if (slot.done < slot.length) {
+				// short transfer, queue the rest from the same buffer
+				queue_slot(op, index);
+				continue;
+			}
+			if (op == Op::READ) { memcpy(slot.user, m_slotBuffers.buffer(index), slot.length); }
+			slot.busy = false;
+			inFlight--;
+		}
+		__atomic_store_n(m_cqHead, head, __ATOMIC_RELEASE);
+	}
+
+	if (error != 0) { throw std::runtime_error(std::string("I/O error: ") + strerror(error)); }
+}
+
+std::unique_ptr<mdfs::IoEngine> mdfs::UringEngine::create(const IoEngineOptions &options) {
+	return std::make_unique<UringEngine>(options);
+}
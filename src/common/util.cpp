@@ -0,0 +1,11 @@
+#include <cerrno>
+#include <common/util.hpp>
+#include <cstring>
+#include <stdexcept>
+
+void mdfs::throw_errno(const std::string &what) { throw std::runtime_error(what + ": " + strerror(errno)); }
+
+bool mdfs::all_zeros(const void *data, size_t size) {
+	const char *bytes = static_cast<const char *>(data);
+	return size == 0 || (bytes[0] == 0 && memcmp(bytes, bytes + 1, size - 1) == 0);
+}
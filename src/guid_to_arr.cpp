@@ -1,34 +1,168 @@
+#include <cctype>
+#include <common/CLI11.hpp>
+#include <common/guid.hpp>
+#include <cstdio>
 #include <cstdlib>
+#include <fstream>
 #include <iostream>
-#include <regex>
 #include <string>
+#include <vector>
 
-#define GUID_REGEX                                                                                                     \
-	R"(^([0-9a-fA-F]{8})-([0-9a-fA-F]{4})-([0-9a-fA-F]{4})-([0-9a-fA-F]{2})([0-9a-fA-F]{2})-([0-9a-fA-F]{12})$)"
+struct UuidArrInfo {
+	std::vector<std::string> guids;
+	std::vector<std::string> files;
+	std::string headerGuard;
+	bool upper = false;
+};
 
-int main(int argc, char **argv) {
-	if (argc != 2) {
-		std::cerr << "Invalid arguments\n";
-		return EXIT_FAILURE;
+// the whole output is collected and written once every input converted, so a failed run writes nothing
+class Output {
+public:
+	std::string &buffer() { return m_buffer; }
+	// returns false if stdout couldn't take all of it
+	bool flush() {
+		bool written = fwrite(m_buffer.data(), 1, m_buffer.size(), stdout) == m_buffer.size();
+		m_buffer.clear();
+		return fflush(stdout) == 0 && written;
+	}
+
+private:
+	std::string m_buffer;
+};
+
+static bool is_identifier(std::string_view name) {
+	if (name.empty() || std::isdigit(uint8_t(name[0]))) { return false; }
+	for (char c : name) {
+		if (!std::isalnum(uint8_t(c)) && c != '_') { return false; }
+	}
+	return true;
+}
+
+static void append_initializer(std::string &out, const GUID &uuid, bool upper) {
+	char text[UUID_STRING_LENGTH];
+	format_uuid(uuid, text);
+	if (upper) {
+		for (char &c : text) { c = char(std::toupper(uint8_t(c))); }
 	}
+	std::string_view digits(text, UUID_STRING_LENGTH);
 
-	std::string in = argv[1];
-	std::regex guid_regex(GUID_REGEX);
-	std::smatch matches;
+	out.append("{ 0x").append(digits.substr(0, 8)).append(", 0x").append(digits.substr(9, 4)).append(", 0x");
+	out.append(digits.substr(14, 4)).append(", { 0x").append(digits.substr(19, 2)).append(", 0x");
+	out.append(digits.substr(21, 2));
+	for (size_t i = 24; i < UUID_STRING_LENGTH; i += 2) { out.append(", 0x").append(digits.substr(i, 2)); }
+	out.append("}}");
+}
 
-	if (!std::regex_match(in, matches, guid_regex) || matches.size() < 7) {
-		std::cerr << "Failed to match UUID\n";
+// a line is a GUID, followed by the name of the constant to define for it with --header. blank lines and lines
+// starting with # are skipped. returns false and prints where the error is if the line can't be converted
+static bool convert_line(std::string_view line, const std::string &source, size_t lineNumber, const UuidArrInfo &info,
+						 Output &out) {
+	size_t start = line.find_first_not_of(" \t\r");
+	if (start == std::string_view::npos || line[start] == '#') { return true; }
+	line.remove_prefix(start);
+	line.remove_suffix(line.size() - (line.find_last_not_of(" \t\r") + 1));
+
+	std::string_view text = line.substr(0, std::min(line.find_first_of(" \t"), line.size()));
+	std::string_view name;
+	if (text.size() < line.size()) {
+		name = line.substr(text.size());
+		name.remove_prefix(name.find_first_not_of(" \t"));
+	}
+
+	GUID uuid;
+	if (!parse_uuid(text, &uuid)) {
+		std::cerr << source << ":" << lineNumber << ": Failed to match UUID\n";
+		return false;
+	}
+
+	if (info.headerGuard.empty()) {
+		if (!name.empty()) {
+			std::cerr << source << ":" << lineNumber << ": Unexpected text after the GUID, names are only used with "
+					  << "--header\n";
+			return false;
+		}
+		append_initializer(out.buffer(), uuid, info.upper);
+		out.buffer().push_back('\n');
+	} else {
+		if (!is_identifier(name)) {
+			std::cerr << source << ":" << lineNumber << ": Header output needs a constant name after the GUID\n";
+			return false;
+		}
+		// same layout as the constants in common/gpt.hpp
+		out.buffer().append("#define ").append(name).append(" GUID(");
+		append_initializer(out.buffer(), uuid, info.upper);
+		out.buffer().append(")\n");
+	}
+	return true;
+}
+
+static bool convert_stream(std::istream &in, const std::string &source, const UuidArrInfo &info, Output &out) {
+	std::string line;
+	size_t lineNumber = 0;
+	while (std::getline(in, line)) {
+		if (!convert_line(line, source, ++lineNumber, info, out)) { return false; }
+	}
+	return true;
+}
+
+int main(int argc, char **argv) {
+	CLI::App app{"Converts GUIDs to C initializers"};
+	argv = app.ensure_utf8(argv);
+
+	UuidArrInfo info;
+	app.add_option("guids", info.guids,
+				   "GUIDs to convert. With --header each is followed by a constant name as the next argument");
+	app.add_option("-f,--file", info.files, "Files with one GUID per line, - reads stdin");
+	app.add_option("--header", info.headerGuard,
+				   "Emit a complete header with this include guard, defining the constant named after each GUID");
+	app.add_flag("-u,--upper", info.upper, "Print hex digits in upper case");
+
+	CLI11_PARSE(app, argc, argv);
+
+	if (!info.headerGuard.empty() && !is_identifier(info.headerGuard)) {
+		std::cerr << "Invalid include guard: " << info.headerGuard << "\n";
 		return EXIT_FAILURE;
 	}
+	// nothing given on the command line, read the GUIDs from stdin
+	if (info.guids.empty() && info.files.empty()) { info.files.push_back("-"); }
+
+	Output out;
+	if (!info.headerGuard.empty()) {
+		out.buffer().append("#ifndef ").append(info.headerGuard).append("\n#define ").append(info.headerGuard);
+		out.buffer().append("\n\n#include <common/guid.hpp>\n\n");
+	}
 
-	std::cout << "{ 0x" << matches[1].str() << ", 0x" << matches[2].str() << ", 0x" << matches[3].str() << ", { 0x"
-			  << matches[4].str() << ", 0x" << matches[5].str();
+	for (size_t i = 0; i < info.guids.size(); i++) {
+		std::string line = info.guids[i];
+		size_t argument = i + 1;
+		// with --header an argument that isn't a GUID names the constant of the GUID before it, unless that already
+		// has a name. without it every argument has to be a GUID
+		GUID next;
+		if (!info.headerGuard.empty() && i + 1 < info.guids.size() && line.find_first_of(" \t") == std::string::npos &&
+			!parse_uuid(info.guids[i + 1], &next)) {
+			line.append(" ").append(info.guids[++i]);
+		}
+		if (!convert_line(line, "argument", argument, info, out)) { return EXIT_FAILURE; }
+	}
 
-	for (size_t i = 0; i < 12; i += 2) {
-		std::string d4 = matches[6].str().substr(i, 2);
-		std::cout << ", 0x" << d4;
+	std::ios::sync_with_stdio(false);
+	for (const std::string &file : info.files) {
+		if (file == "-") {
+			if (!convert_stream(std::cin, "stdin", info, out)) { return EXIT_FAILURE; }
+			continue;
+		}
+		std::ifstream in(file);
+		if (!in.is_open()) {
+			std::cerr << "Failed to open " << file << "\n";
+			return EXIT_FAILURE;
+		}
+		if (!convert_stream(in, file, info, out)) { return EXIT_FAILURE; }
 	}
 
-	std::cout << "}}\n";
+	if (!info.headerGuard.empty()) { out.buffer().append("\n#endif\n"); }
+	if (!out.flush()) {
+		std::cerr << "Failed to write the output\n";
+		return EXIT_FAILURE;
+	}
 	return EXIT_SUCCESS;
-}
\ No newline at end of file
+}
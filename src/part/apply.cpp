@@ -0,0 +1,76 @@
+#include <common/block_device.hpp>
+#include <filesystem>
+#include <iostream>
+#include <part/apply.hpp>
+#include <part/format.hpp>
+#include <part/io_options.hpp>
+#include <part/layout.hpp>
+#include <sstream>
+
+CLI::App *mdfs::make_apply_app(mdfs::ApplyInfo &info, CLI::App &app) {
+	CLI::App *apply = app.add_subcommand("apply", "Writes the partition tables described by a layout file");
+	apply->add_option("-l,--layout", info.layoutFile, "Layout file, - reads it from stdin")->required();
+	apply->add_option("images", info.images, "Disk images to write the layout to")->required();
+	mdfs::add_io_options(apply, info.io);
+	apply->add_flag("-D,--dry", "If specified, prints where the partitions would go without writing anything");
+	apply->add_flag("-q,--quiet", "If specified, only errors are printed");
+	return apply;
+}
+
+// the tables are built completely in memory, so an image only sees one batch covering the primary and the backup
+// regions, and nothing in between is touched
+bool mdfs::apply_layout(const mdfs::Layout &layout, const std::string &path, const mdfs::IoEngineOptions &io,
+						bool dryRun, std::ostream &out) {
+	try {
+		mdfs::BlockDevice disk(path, layout.sectorSize, dryRun ? std::ios::in : std::ios::in | std::ios::out, io);
+		mdfs::LayoutTables tables = mdfs::build_layout(layout, disk.size_lba());
+		if (!dryRun) {
+			mdfs::WriteBatch batch;
+			batch.add(0, tables.primary.data(), tables.primary.size() / layout.sectorSize);
+			batch.add(tables.backupLBA, tables.backup.data(), tables.backup.size() / layout.sectorSize);
+			disk.submit(batch);
+		}
+
+		out << path << ": " << (layout.type == mdfs::PartType::GPT ? "GPT" : "MBR") << " with "
+			<< tables.partitions.size() << " partitions\n";
+		for (const mdfs::PlacedPartition &placed : tables.partitions) {
+			out << "  " << placed.index + 1 << ": LBA " << placed.firstLBA << " - " << placed.lastLBA << " ("
+				<< mdfs::size_string((placed.lastLBA - placed.firstLBA + 1) * layout.sectorSize) << ")\n";
+		}
+		return true;
+	} catch (const std::exception &e) {
+		std::cerr << path << ": " << e.what() << "\n";
+		return false;
+	}
+}
+
+int mdfs::do_apply(mdfs::ApplyInfo &info, const CLI::App *app) {
+	Layout layout;
+	try {
+		layout = read_layout_file(info.layoutFile);
+	} catch (const std::exception &e) {
+		std::cerr << info.layoutFile << ": " << e.what() << "\n";
+		return EXIT_FAILURE;
+	}
+
+	for (const LayoutPartition &partition : layout.partitions) {
+		if (partition.source.empty()) { continue; }
+		std::cerr << info.layoutFile << ": partition sources are only written by stream\n";
+		return EXIT_FAILURE;
+	}
+
+	bool dryRun = app->count("--dry");
+	bool quiet = app->count("--quiet");
+	bool allApplied = true;
+	for (const std::string &image : info.images) {
+		if (!std::filesystem::exists(image)) {
+			std::cerr << image << ": disk image doesn't exist\n";
+			allApplied = false;
+			continue;
+		}
+		std::ostringstream out;
+		allApplied = apply_layout(layout, image, info.io, dryRun, out) && allApplied;
+		if (!quiet) { std::cout << out.str(); }
+	}
+	return allApplied ? EXIT_SUCCESS : EXIT_FAILURE;
+}
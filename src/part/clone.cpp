@@ -0,0 +1,99 @@
+#include <common/block_device.hpp>
+#include <common/clone.hpp>
+#include <common/gpt_editor.hpp>
+#include <common/table_reader.hpp>
+#include <iostream>
+#include <part/clone.hpp>
+#include <part/format.hpp>
+#include <part/io_options.hpp>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+CLI::App *mdfs::make_clone_app(mdfs::CloneInfo &info, CLI::App &app) {
+	CLI::App *clone = app.add_subcommand("clone", "Copies a disk image, keeping holes and sharing blocks if possible");
+	clone->add_option("source", info.source, "Disk image to copy")->required();
+	clone->add_option("destination", info.destination, "Disk image to create")->required();
+	clone->add_option("-m,--method", info.method,
+					  "How to copy, auto tries reflink, then copy_file_range over the data extents, then buffered "
+					  "copies")
+			->check(CLI::IsMember({"auto", "reflink", "extents", "buffered"}))
+			->default_str("auto");
+	clone->add_flag("-f,--force", "If specified, an existing destination is replaced");
+	clone->add_flag("-r,--randomize-guids",
+					"If specified, the clone gets new disk and partition GUIDs, or a new disk signature for MBR");
+	mdfs::add_io_options(clone, info.io);
+	return clone;
+}
+
+// only the headers and the entry sectors holding partitions are rewritten, so a reflinked clone keeps sharing
+// everything else with its source
+static void randomize_guids(const std::string &path, const mdfs::IoEngineOptions &io) {
+	mdfs::BlockDevice disk(path, 512, std::ios::in | std::ios::out, io);
+	mdfs::PartitionTableReader reader(disk);
+	if (reader.read_detecting_sector_size() != mdfs::Result::SUCCESS) {
+		throw std::runtime_error("image is too small to hold a partition table");
+	}
+
+	if (reader.active()) {
+		mdfs::GptEditor editor(disk);
+		if (editor.load() != mdfs::Result::SUCCESS) { throw std::runtime_error("could not load the GPT"); }
+		std::vector<uint32_t> used;
+		for (auto [index, entry] : editor.entries()) { used.push_back(index); }
+		std::vector<GUID> guids(used.size() + 1);
+		if (gen_random_UUIDv4(guids.data(), guids.size()) != mdfs::Result::SUCCESS) {
+			throw std::runtime_error("could not generate GUIDs");
+		}
+		editor.set_disk_guid(guids[0]);
+		for (size_t i = 0; i < used.size(); i++) {
+			mdfs::PartitionEntryGPT entry = editor.entry(used[i]);
+			entry.uniquePartitionGUID = guids[i + 1];
+			editor.set_entry(used[i], entry);
+		}
+		editor.commit();
+		std::cout << "New disk GUID " << mdfs::guid_string(guids[0]) << " and " << used.size()
+				  << " new partition GUIDs\n";
+		return;
+	}
+	if (!reader.has_mbr_signature() || reader.has_protective_mbr()) {
+		throw std::runtime_error("image has no usable partition table");
+	}
+	mdfs::mbr::MBR mbr = reader.mbr();
+	std::random_device rd;
+	mbr.RDiskSignature = rd();
+	disk.write_at(0, &mbr, sizeof(mbr));
+	disk.sync(0, 1);
+	std::cout << "New disk signature 0x" << std::hex << mbr.RDiskSignature << std::dec << "\n";
+}
+
+int mdfs::do_clone(mdfs::CloneInfo &info, const CLI::App *app) {
+	CloneMethod method = CloneMethod::AUTO;
+	if (info.method == "reflink") {
+		method = CloneMethod::REFLINK;
+	} else if (info.method == "extents") {
+		method = CloneMethod::EXTENTS;
+	} else if (info.method == "buffered") {
+		method = CloneMethod::BUFFERED;
+	}
+	CloneResult result;
+	try {
+		result = clone_image(info.source, info.destination, method, app->count("--force"), info.io);
+	} catch (const std::exception &e) {
+		std::cerr << e.what() << "\n";
+		return EXIT_FAILURE;
+	}
+	std::cout << "Cloned " << info.source << " to " << info.destination << " with " << clone_method_name(result.method);
+	if (result.method != CloneMethod::REFLINK) {
+		std::cout << ", " << result.extents << " data extents holding " << size_string(result.dataBytes);
+	}
+	std::cout << "\n";
+
+	if (!app->count("--randomize-guids")) { return EXIT_SUCCESS; }
+	try {
+		randomize_guids(info.destination, info.io);
+	} catch (const std::exception &e) {
+		std::cerr << info.destination << ": " << e.what() << "\n";
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,88 @@
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <part/apply.hpp>
+#include <part/create.hpp>
+#include <part/format.hpp>
+#include <part/initpart.hpp>
+#include <part/io_options.hpp>
+#include <random>
+#include <strings.h>
+#include <unistd.h>
+
+CLI::App *mdfs::make_create_app(mdfs::CreateInfo &info, CLI::App &app) {
+	CLI::App *create = app.add_subcommand("create", "Creates a sparse disk image, optionally with partition tables");
+	create->add_option("image", info.outFile, "Disk image to create")->required();
+	create->add_option("-s,--size", info.size, "Size of the image, like 64G")->required();
+	create->add_flag("-p,--preallocate", "If specified, the image's blocks are allocated up front with fallocate");
+	create->add_flag("-f,--force", "If specified, an existing file is truncated and replaced");
+	CLI::Option *table = create->add_option("-t,--table", info.table, "Empty partition table to create, GPT or MBR")
+								 ->check(CLI::IsMember({"gpt", "mbr"}, CLI::ignore_case));
+	create->add_option("-l,--layout", info.layoutFile, "Layout file to apply, see apply")->excludes(table);
+	create->add_option("--sector_size", info.sectorSize, "Sector size of the table created with --table")
+			->default_val(512)
+			->needs(table);
+	mdfs::add_io_options(create, info.io);
+	return create;
+}
+
+// ftruncate only sets the size, the file has no data blocks until something is written to it
+static bool create_image(const std::string &path, uint64_t size, bool preallocate, bool force) {
+	int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC | (force ? O_TRUNC : O_EXCL), 0644);
+	if (fd < 0) {
+		std::cerr << "Could not create " << path << ": " << strerror(errno)
+				  << (errno == EEXIST ? ", use --force to replace it" : "") << "\n";
+		return false;
+	}
+	bool created = ftruncate(fd, off_t(size)) == 0;
+	if (!created) { std::cerr << "Could not resize " << path << ": " << strerror(errno) << "\n"; }
+	if (created && preallocate && fallocate(fd, 0, 0, off_t(size)) != 0) {
+		std::cerr << "Could not preallocate " << path << ": " << strerror(errno) << "\n";
+		created = false;
+	}
+	close(fd);
+	if (!created) { unlink(path.c_str()); }
+	return created;
+}
+
+int mdfs::do_create(mdfs::CreateInfo &info, const CLI::App *app) {
+	std::optional<Layout> layout;
+	if (!info.layoutFile.empty()) {
+		try {
+			layout = read_layout_file(info.layoutFile);
+		} catch (const std::exception &e) {
+			std::cerr << info.layoutFile << ": " << e.what() << "\n";
+			return EXIT_FAILURE;
+		}
+	}
+	std::optional<uint64_t> size = parse_size(info.size, layout ? layout->sectorSize : info.sectorSize);
+	if (!size || *size == 0) {
+		std::cerr << "Invalid image size \"" << info.size << "\".\n";
+		return EXIT_FAILURE;
+	}
+
+	bool preallocate = app->count("--preallocate");
+	if (!create_image(info.outFile, *size, preallocate, app->count("--force"))) { return EXIT_FAILURE; }
+	std::cout << "Created " << info.outFile << ": " << size_string(*size) << (preallocate ? ", preallocated" : ", sparse")
+			  << "\n";
+
+	// the tables are written by the same code as initpart and apply, the image is just never reopened by another
+	// process
+	if (layout) { return apply_layout(*layout, info.outFile, info.io, false, std::cout) ? EXIT_SUCCESS : EXIT_FAILURE; }
+	if (info.table.empty()) { return EXIT_SUCCESS; }
+
+	InitpartRunInfo runInfo;
+	runInfo.inFile = info.outFile;
+	runInfo.type = strcasecmp(info.table.c_str(), "gpt") == 0 ? PartType::GPT : PartType::MBR;
+	runInfo.sectorSize = info.sectorSize;
+	runInfo.io = info.io;
+	runInfo.partitionEntryCount = 128;
+	if (runInfo.type == PartType::GPT && gen_random_UUIDv4(&runInfo.disk_guid) != Result::SUCCESS) {
+		std::cerr << "Could not generate a disk GUID\n";
+		return EXIT_FAILURE;
+	}
+	std::random_device rd;
+	runInfo.diskSignature = rd();
+	return make_partition_table(runInfo) == Result::SUCCESS ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,325 @@
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <common/block_device.hpp>
+#include <common/clone.hpp>
+#include <common/extent_map.hpp>
+#include <common/stream_writer.hpp>
+#include <common/util.hpp>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <fcntl.h>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <optional>
+#include <part/delta.hpp>
+#include <part/format.hpp>
+#include <part/io_options.hpp>
+#include <stdexcept>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+CLI::App *mdfs::make_diff_app(mdfs::DiffInfo &info, CLI::App &app) {
+	CLI::App *diff = app.add_subcommand("diff", "Writes the blocks that differ between two disk images as a delta");
+	diff->add_option("base", info.base, "Disk image the delta applies to")->required();
+	diff->add_option("image", info.image, "Disk image the delta turns base into")->required();
+	diff->add_option("-o,--output", info.output, "File to write the delta to, - writes to stdout")->default_str("-");
+	diff->add_option("-b,--block-size", info.blockSize, "Size of the blocks compared, a multiple of 512 bytes")
+			->default_str("64K");
+	diff->add_option("-j,--jobs", info.jobs, "Number of threads comparing blocks")->default_str("All CPUs");
+	mdfs::add_io_options(diff, info.io);
+	diff->get_option("--io-engine")->default_str("mmap");
+	return diff;
+}
+
+CLI::App *mdfs::make_patch_app(mdfs::PatchInfo &info, CLI::App &app) {
+	CLI::App *patch = app.add_subcommand("patch", "Applies a delta written by diff to a disk image");
+	patch->add_option("base", info.base, "Disk image to patch")->required();
+	patch->add_option("delta", info.delta, "Delta to apply, - reads stdin")->default_str("-");
+	patch->add_option("-o,--output", info.output, "Clone base here and patch the clone instead")
+			->default_str("Patch base in place");
+	patch->add_flag("-f,--force", "If specified, an existing output is replaced");
+	patch->add_flag("--skip-base-check", "If specified, base isn't checked against the delta before patching");
+	patch->add_option("-j,--jobs", info.jobs, "Number of threads checksumming blocks")->default_str("All CPUs");
+	mdfs::add_io_options(patch, info.io);
+	return patch;
+}
+
+// calls work(index, buffer) for every index below count from jobs threads, each with its own blockSize buffer.
+// threads claim a run of indices at a time to keep the shared counter cold
+static void parallel_blocks(uint64_t count, size_t jobs, size_t blockSize,
+							const std::function<void(uint64_t, std::vector<char> &)> &work) {
+	const uint64_t claim = 64;
+	jobs = jobs ? jobs : std::max(1u, std::thread::hardware_concurrency());
+	jobs = std::max<size_t>(1, std::min<uint64_t>(jobs, (count + claim - 1) / claim));
+	std::atomic<uint64_t> next = 0;
+	std::exception_ptr error;
+	std::mutex errorMutex;
+	auto worker = [&]() {
+		try {
+			std::vector<char> buffer(blockSize);
+			for (uint64_t first = next.fetch_add(claim); first < count; first = next.fetch_add(claim)) {
+				for (uint64_t index = first; index < std::min(count, first + claim); index++) { work(index, buffer); }
+			}
+		} catch (...) {
+			std::lock_guard lock(errorMutex);
+			if (!error) { error = std::current_exception(); }
+			next = count;
+		}
+	};
+	std::vector<std::thread> threads;
+	for (size_t i = 1; i < jobs; i++) { threads.emplace_back(worker); }
+	worker();
+	for (std::thread &thread : threads) { thread.join(); }
+	if (error) { std::rethrow_exception(error); }
+}
+
+static uint64_t block_length(uint64_t block, uint64_t blockSize, uint64_t imageSize) {
+	uint64_t offset = block * blockSize;
+	return offset < imageSize ? std::min(blockSize, imageSize - offset) : 0;
+}
+
+// the per block CRCs merged in order, which is the CRC of the whole image
+static crc32_t combine_blocks(const std::vector<crc32_t> &crcs, uint64_t blockSize, uint64_t imageSize) {
+	crc32_t crc = 0;
+	for (uint64_t block = 0; block < crcs.size(); block++) {
+		crc = mdfs::crc32_combine(crc, crcs[block], block_length(block, blockSize, imageSize));
+	}
+	return crc;
+}
+
+static uint64_t image_size(const std::string &path) {
+	struct stat st;
+	if (stat(path.c_str(), &st) != 0) { mdfs::throw_errno("Failed to stat " + path); }
+	if (st.st_size % 512 != 0) { throw std::runtime_error(path + " is not a multiple of 512 bytes long"); }
+	return uint64_t(st.st_size);
+}
+
+// blocks are checksummed in parallel, holes are checksummed with crc32_zeros without being read
+static crc32_t image_crc(const std::string &path, uint64_t blockSize, size_t jobs, const mdfs::IoEngineOptions &io) {
+	uint64_t size = image_size(path);
+	if (size == 0) { return 0; }
+	mdfs::ExtentMap map(path);
+	mdfs::BlockDevice disk(path, 512, std::ios::in, io);
+	uint64_t blocks = (size + blockSize - 1) / blockSize;
+	std::vector<crc32_t> crcs(blocks);
+	crc32_t zeroCRC = mdfs::crc32_zeros(blockSize);
+	parallel_blocks(blocks, jobs, blockSize, [&](uint64_t block, std::vector<char> &buffer) {
+		uint64_t offset = block * blockSize;
+		uint64_t length = block_length(block, blockSize, size);
+		if (map.is_hole(offset, length)) {
+			crcs[block] = length == blockSize ? zeroCRC : mdfs::crc32_zeros(length);
+			return;
+		}
+		disk.read_at(offset, buffer.data(), length);
+		crcs[block] = mdfs::crc32(buffer.data(), length);
+	});
+	return combine_blocks(crcs, blockSize, size);
+}
+
+int mdfs::do_diff(mdfs::DiffInfo &info, [[maybe_unused]] const CLI::App *app) {
+	int out = -1;
+	try {
+		std::optional<uint64_t> blockSize = parse_size(info.blockSize, 512);
+		if (!blockSize || *blockSize == 0 || *blockSize % 512 != 0 || *blockSize > UINT32_MAX) {
+			throw std::runtime_error("Invalid block size " + info.blockSize);
+		}
+		uint64_t baseSize = image_size(info.base);
+		uint64_t newSize = image_size(info.image);
+		ExtentMap baseMap(info.base);
+		ExtentMap newMap(info.image);
+		BlockDevice base(info.base, 512, std::ios::in, info.io);
+		BlockDevice image(info.image, 512, std::ios::in, info.io);
+
+		// both images are on hand, so blocks are compared byte for byte while both are checksummed. the base reads
+		// as zeros in its holes and past its end, which is what a patched image holds there after truncation
+		uint64_t newBlocks = (newSize + *blockSize - 1) / *blockSize;
+		uint64_t baseBlocks = (baseSize + *blockSize - 1) / *blockSize;
+		std::vector<crc32_t> newCRCs(newBlocks);
+		std::vector<crc32_t> baseCRCs(baseBlocks);
+		std::vector<uint8_t> kinds(newBlocks, 0);
+		crc32_t zeroCRC = crc32_zeros(*blockSize);
+		std::vector<char> zeros(*blockSize, 0);
+		parallel_blocks(std::max(newBlocks, baseBlocks), info.jobs, *blockSize * 2,
+						[&](uint64_t block, std::vector<char> &buffer) {
+							uint64_t offset = block * *blockSize;
+							uint64_t newLength = block_length(block, *blockSize, newSize);
+							uint64_t baseLength = block_length(block, *blockSize, baseSize);
+							bool newHole = newLength == 0 || newMap.is_hole(offset, newLength);
+							bool baseHole = baseLength == 0 || baseMap.is_hole(offset, baseLength);
+							const char *newData = zeros.data();
+							const char *baseData = zeros.data();
+							if (!newHole) {
+								image.read_at(offset, buffer.data(), newLength);
+								newData = buffer.data();
+							}
+							if (!baseHole) {
+								base.read_at(offset, buffer.data() + *blockSize, baseLength);
+								baseData = buffer.data() + *blockSize;
+							}
+							auto crc = [&](const char *data, uint64_t length, bool hole) {
+								if (!hole) { return crc32(data, length); }
+								return length == *blockSize ? zeroCRC : crc32_zeros(length);
+							};
+							if (baseLength) { baseCRCs[block] = crc(baseData, baseLength, baseHole); }
+							if (newLength == 0) { return; }
+							newCRCs[block] = crc(newData, newLength, newHole);
+
+							uint64_t common = std::min(newLength, baseLength);
+							bool same = (newHole && baseHole) ||
+										(memcmp(newData, baseData, common) == 0 &&
+										 all_zeros(newData + common, newLength - common));
+							if (same) { return; }
+							kinds[block] = uint8_t(newHole || all_zeros(newData, newLength) ? DeltaKind::ZERO
+																							  : DeltaKind::DATA);
+						});
+
+		if (info.output == "-") {
+			if (isatty(STDOUT_FILENO)) { throw std::runtime_error("Refusing to write a delta to a terminal"); }
+			out = STDOUT_FILENO;
+		} else {
+			out = open(info.output.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+			if (out < 0) { throw_errno("Failed to open " + info.output); }
+		}
+		int imageFd = open(info.image.c_str(), O_RDONLY | O_CLOEXEC);
+		if (imageFd < 0) { throw_errno("Failed to open " + info.image); }
+
+		// changed blocks go from the image straight into the output, without another trip through user space
+		StreamWriter writer(out);
+		DeltaHeader header = {.blockSize = uint32_t(*blockSize),
+							  .baseSize = baseSize,
+							  .newSize = newSize,
+							  .baseCRC = combine_blocks(baseCRCs, *blockSize, baseSize)};
+		writer.write(&header, sizeof(header));
+		uint64_t changed = 0;
+		uint64_t changedBytes = 0;
+		for (uint64_t block = 0; block < newBlocks; block++) {
+			if (kinds[block] == 0) { continue; }
+			DeltaRecord record = {.block = block, .kind = DeltaKind(kinds[block]), .crc = newCRCs[block]};
+			writer.write(&record, sizeof(record));
+			uint64_t length = block_length(block, *blockSize, newSize);
+			if (record.kind == DeltaKind::DATA) {
+				writer.write_file(imageFd, block * *blockSize, length);
+				changedBytes += length;
+			}
+			changed++;
+		}
+		DeltaRecord end = {
+				.block = newBlocks, .kind = DeltaKind::END, .crc = combine_blocks(newCRCs, *blockSize, newSize)};
+		writer.write(&end, sizeof(end));
+		writer.finish();
+		close(imageFd);
+		std::cerr << changed << " of " << newBlocks << " blocks changed, " << size_string(changedBytes) << " of data\n";
+	} catch (const std::exception &e) {
+		std::cerr << e.what() << "\n";
+		if (out > STDOUT_FILENO) { close(out); }
+		return EXIT_FAILURE;
+	}
+	if (out > STDOUT_FILENO) { close(out); }
+	return EXIT_SUCCESS;
+}
+
+static void read_exactly(FILE *in, void *data, size_t size) {
+	if (fread(data, 1, size, in) == size) { return; }
+	if (ferror(in)) { mdfs::throw_errno("Failed to read the delta"); }
+	throw std::runtime_error("Delta ended early");
+}
+
+// records are applied as they are read, the delta is never held in memory as a whole
+static void apply_delta(FILE *in, const mdfs::DeltaHeader &header, const std::string &path,
+						const mdfs::PatchInfo &info) {
+	if (truncate(path.c_str(), off_t(header.newSize)) != 0) {
+		mdfs::throw_errno("Failed to resize " + path);
+	}
+	uint64_t blocks = (header.newSize + header.blockSize - 1) / header.blockSize;
+	std::vector<char> buffer(header.blockSize);
+	std::optional<crc32_t> expected;
+	{
+		mdfs::BlockDevice disk(path, 512, std::ios::in | std::ios::out, info.io);
+		uint64_t previous = 0;
+		for (bool first = true;; first = false) {
+			mdfs::DeltaRecord record;
+			read_exactly(in, &record, sizeof(record));
+			if (record.kind == mdfs::DeltaKind::END) {
+				expected = crc32_t(record.crc);
+				break;
+			}
+			if (record.block >= blocks || (!first && record.block <= previous)) {
+				throw std::runtime_error("Delta has an out of order block " + std::to_string(record.block));
+			}
+			previous = record.block;
+			uint64_t offset = record.block * header.blockSize;
+			uint64_t length = block_length(record.block, header.blockSize, header.newSize);
+			if (record.kind == mdfs::DeltaKind::ZERO) {
+				disk.zero_range(offset / 512, length / 512);
+			} else if (record.kind == mdfs::DeltaKind::DATA) {
+				read_exactly(in, buffer.data(), length);
+				// checksummed on its way to the image. a corrupted block is written before it is caught, the image is
+				// part way patched by then anyway and patching stops there
+				mdfs::Crc32 crc;
+				disk.write_at(offset, buffer.data(), length, crc);
+				if (crc.finalize() != record.crc) {
+					throw std::runtime_error("Delta is corrupted at block " + std::to_string(record.block));
+				}
+			} else {
+				throw std::runtime_error("Delta has an unknown record type");
+			}
+		}
+		disk.flush();
+	}
+
+	crc32_t crc = image_crc(path, header.blockSize, info.jobs, info.io);
+	if (crc != *expected) {
+		throw std::runtime_error("Patched image doesn't match the delta's checksum, " + path + " is damaged");
+	}
+}
+
+int mdfs::do_patch(mdfs::PatchInfo &info, const CLI::App *app) {
+	FILE *in = stdin;
+	// set once the output is a clone made here, which is then removed on any failure
+	bool cloned = false;
+	try {
+		if (info.delta != "-") {
+			in = fopen(info.delta.c_str(), "rb");
+			if (!in) { throw_errno("Failed to open " + info.delta); }
+		}
+		setvbuf(in, nullptr, _IOFBF, 1048576);
+		DeltaHeader header;
+		read_exactly(in, &header, sizeof(header));
+		if (memcmp(header.magic, DELTA_MAGIC, sizeof(header.magic)) != 0 || header.version != DELTA_VERSION ||
+			header.blockSize == 0 || header.blockSize % 512 != 0 || header.newSize % 512 != 0) {
+			throw std::runtime_error(info.delta + " is not a delta written by diff");
+		}
+
+		std::string target = info.base;
+		if (!info.output.empty()) {
+			struct stat baseSt, outputSt;
+			if (stat(info.base.c_str(), &baseSt) == 0 && stat(info.output.c_str(), &outputSt) == 0 &&
+				baseSt.st_dev == outputSt.st_dev && baseSt.st_ino == outputSt.st_ino) {
+				throw std::runtime_error(info.output + " is " + info.base + ", leave out -o to patch it in place");
+			}
+			clone_image(info.base, info.output, CloneMethod::AUTO, app->count("--force"), info.io);
+			cloned = true;
+			target = info.output;
+		}
+		if (!app->count("--skip-base-check")) {
+			if (image_size(target) != header.baseSize ||
+				image_crc(target, header.blockSize, info.jobs, info.io) != header.baseCRC) {
+				throw std::runtime_error(info.base + " is not the image the delta was made from");
+			}
+		}
+		apply_delta(in, header, target, info);
+		std::cout << "Patched " << target << "\n";
+	} catch (const std::exception &e) {
+		std::cerr << e.what() << "\n";
+		if (cloned) { unlink(info.output.c_str()); }
+		if (in && in != stdin) { fclose(in); }
+		return EXIT_FAILURE;
+	}
+	if (in != stdin) { fclose(in); }
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,118 @@
+#include <cctype>
+#include <common/gpt.hpp>
+#include <common/units.hpp>
+#include <cstring>
+#include <cstdio>
+#include <iomanip>
+#include <iterator>
+#include <part/format.hpp>
+#include <sstream>
+#include <strings.h>
+
+std::string mdfs::guid_string(const GUID &uuid) {
+	char text[UUID_STRING_LENGTH];
+	format_uuid(uuid, text);
+	return std::string(text, UUID_STRING_LENGTH);
+}
+
+std::string mdfs::json_string(const std::string &str) {
+	std::string out = "\"";
+	for (char c : str) {
+		if (c == '"' || c == '\\') {
+			out.push_back('\\');
+			out.push_back(c);
+		} else if (uint8_t(c) < 0x20) {
+			char escaped[8];
+			snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+			out.append(escaped);
+		} else {
+			out.push_back(c);
+		}
+	}
+	return out + "\"";
+}
+
+std::string mdfs::size_string(uint64_t bytes) {
+	const char *suffixes[] = {"B", "KiB", "MiB", "GiB", "TiB", "PiB"};
+	size_t suffix = 0;
+	double size = double(bytes);
+	while (size >= 1024 && suffix + 1 < std::size(suffixes)) {
+		size /= 1024;
+		suffix++;
+	}
+	std::ostringstream out;
+	out << std::fixed << std::setprecision(suffix == 0 ? 0 : 1) << size << " " << suffixes[suffix];
+	return out.str();
+}
+
+std::optional<uint64_t> mdfs::parse_size(std::string_view expression, size_t sectorSize) {
+	size_t digits = 0;
+	uint64_t whole = 0;
+	while (digits < expression.size() && expression[digits] >= '0' && expression[digits] <= '9') {
+		if (whole > (UINT64_MAX - 9) / 10) { return std::nullopt; }
+		whole = whole * 10 + uint64_t(expression[digits++] - '0');
+	}
+	if (digits == 0) { return std::nullopt; }
+
+	// up to 9 fractional digits, kept as a fraction of 10^9
+	uint64_t fraction = 0;
+	uint64_t scale = 1;
+	size_t pos = digits;
+	if (pos < expression.size() && expression[pos] == '.') {
+		for (pos++; pos < expression.size() && expression[pos] >= '0' && expression[pos] <= '9'; pos++) {
+			if (scale == 1000000000) { continue; }
+			fraction = fraction * 10 + uint64_t(expression[pos] - '0');
+			scale *= 10;
+		}
+	}
+
+	std::string unit;
+	for (char c : expression.substr(pos)) { unit.push_back(char(tolower(uint8_t(c)))); }
+	uint64_t multiplier = 0;
+	if (unit.empty() || unit == "b") {
+		multiplier = units::b;
+	} else if (unit == "s") {
+		multiplier = sectorSize;
+	} else {
+		const struct {
+			char prefix;
+			uint64_t multiplier;
+		} prefixes[] = {{'k', units::kb}, {'m', units::mb}, {'g', units::gb}, {'t', units::tb}, {'p', units::pb}};
+		for (auto [prefix, value] : prefixes) {
+			if (unit[0] == prefix && (unit.size() == 1 || unit.substr(1) == "b" || unit.substr(1) == "ib")) {
+				multiplier = value;
+			}
+		}
+	}
+	if (multiplier == 0) { return std::nullopt; }
+
+	unsigned __int128 bytes = (unsigned __int128) whole * multiplier + (unsigned __int128) fraction * multiplier / scale;
+	if (bytes > UINT64_MAX) { return std::nullopt; }
+	return uint64_t(bytes);
+}
+
+std::optional<GUID> mdfs::parse_gpt_type(std::string_view type) {
+	const GUID unused = GPT_UNUSED_PARTITION_ENTRY_GUID;
+	GUID guid;
+	if (type.size() == 5 && strncasecmp(type.data(), "linux", 5) == 0) {
+		guid = GPT_LINUX_FILESYSTEM_DATA_GUID;
+	} else if (type.size() == 3 && strncasecmp(type.data(), "efi", 3) == 0) {
+		guid = GPT_EFI_SYSTEM_PARTITION_GUID;
+	} else if (!parse_uuid(type, &guid) || memcmp(&guid, &unused, sizeof(GUID)) == 0) {
+		return std::nullopt;
+	}
+	return guid;
+}
+
+std::optional<uint8_t> mdfs::parse_mbr_type(std::string_view type) {
+	if (type.size() > 2 && type[0] == '0' && (type[1] == 'x' || type[1] == 'X')) { type.remove_prefix(2); }
+	if (type.empty() || type.size() > 2) { return std::nullopt; }
+	uint8_t value = 0;
+	for (char c : type) {
+		int digit = isdigit(uint8_t(c)) ? c - '0' : isxdigit(uint8_t(c)) ? tolower(uint8_t(c)) - 'a' + 10 : -1;
+		if (digit < 0) { return std::nullopt; }
+		value = uint8_t(value * 16 + digit);
+	}
+	if (value == 0x00) { return std::nullopt; }
+	return value;
+}
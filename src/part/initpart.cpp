@@ -9,6 +9,7 @@
 #include <iomanip>
 #include <iostream>
 #include <part/initpart.hpp>
+#include <part/io_options.hpp>
 #include <random>
 #include <vector>
 
@@ -18,6 +19,7 @@ CLI::App *mdfs::make_initpart_app(mdfs::InitPartInfo &info, CLI::App &app) {
 	initpart->add_option("-i,--img", info.inFile, "Disk image to modify")->required();
 	initpart->add_option("-t,--type", info.type, "Partition table type to create")->default_str("GPT");
 	initpart->add_option("-s,--sector_size", info.sectorSize, "Sector size to use")->default_val(512);
+	mdfs::add_io_options(initpart, info.io);
 
 	// GPT specific
 	initpart->add_option("-c,--part-count", info.partitionEntryCount,
@@ -63,12 +65,16 @@ int mdfs::do_initpart(mdfs::InitPartInfo &info, const CLI::App *app) {
 	}
 
 	runInfo.sectorSize = info.sectorSize;
+	runInfo.io = info.io;
 
 	// GPT specific
 	if (runInfo.type == mdfs::PartType::GPT) {
 		runInfo.partitionEntryCount = info.partitionEntryCount;
 		if (info.disk_guid.empty()) {
-			gen_random_UUIDv4(&runInfo.disk_guid);
+			if (gen_random_UUIDv4(&runInfo.disk_guid) != mdfs::Result::SUCCESS) {
+				std::cout << "Could not generate a disk GUID\n";
+				return EXIT_FAILURE;
+			}
 		} else {
 			if (!get_uuid_from_string(info.disk_guid, &runInfo.disk_guid)) {
 				std::cout << "Could not parse GUID: " << info.disk_guid << "\n";
@@ -158,7 +164,7 @@ static mdfs::Result make_gpt_partition_table(const mdfs::InitpartRunInfo &info)
 			  << std::left << std::setw(20) << "Disk GUID: " << "";
 	print_uuid(diskGuid);
 
-	mdfs::BlockDevice disk(info.inFile, info.sectorSize);
+	mdfs::BlockDevice disk(info.inFile, info.sectorSize, std::ios::in | std::ios::out, info.io);
 
 	size_t totalGptSize = mdfs::align_up<size_t>(
 			info.sectorSize * 2 + (info.partitionEntryCount * sizeof(mdfs::PartitionEntryGPT)), info.sectorSize);
@@ -180,11 +186,9 @@ static mdfs::Result make_gpt_partition_table(const mdfs::InitpartRunInfo &info)
 										.sizeOfPartitionEntries = sizeof(mdfs::PartitionEntryGPT),
 										.partitionEntryArrayCRC32 = 0};
 
-	mdfs::PartitionEntryGPT *partitionEntryArray = new mdfs::PartitionEntryGPT[info.partitionEntryCount];
-	memset(partitionEntryArray, 0x00, info.partitionEntryCount * sizeof(mdfs::PartitionEntryGPT));
+	// the entry array is all zeros, its CRC doesn't need the array itself
 	gptPrimaryHeader.partitionEntryArrayCRC32 =
-			mdfs::crc32(partitionEntryArray, info.partitionEntryCount * sizeof(mdfs::PartitionEntryGPT));
-	delete[] partitionEntryArray;
+			mdfs::crc32_zeros(info.partitionEntryCount * sizeof(mdfs::PartitionEntryGPT));
 
 	gptPrimaryHeader.headerCRC32 = mdfs::crc32(&gptPrimaryHeader, sizeof(mdfs::HeaderGPT));
 
@@ -201,25 +205,20 @@ static mdfs::Result make_gpt_partition_table(const mdfs::InitpartRunInfo &info)
 		return mdfs::Result::SUCCESS;
 	}
 
-	//clear the space for the entries
-	std::vector<char> zeros(disk.size_b(), 0x00);
-	if (info.clearAll) {
-		disk.seekp(0);
-		disk.write((char *) zeros.data(), zeros.size());
-	} else {
-		disk.seekp(0);
-		disk.write((char *) zeros.data(), totalGptSize);
-		disk.seekp((disk.size_b() - totalGptSize) / disk.block_size());
-		disk.write((char *) zeros.data(), totalGptSize);
-	}
+	// both table regions are built in memory with their zeroed entry arrays and committed as one batch
+	size_t totalGptLBA = totalGptSize / disk.block_size();
+	if (info.clearAll) { disk.zero_range(0, disk.size_lba()); }
 
-	// write the data structures
-	disk.seekp(0);
-	disk.write((char *) &protectiveMBR, sizeof(mdfs::mbr::MBR));
-	disk.seekp(1);
-	disk.write((char *) &gptPrimaryHeader, sizeof(mdfs::HeaderGPT));
-	disk.seekp(gptPrimaryHeader.alternateLBA);
-	disk.write((char *) &gptBackupHeader, sizeof(mdfs::HeaderGPT));
+	std::vector<char> primaryRegion(totalGptSize, 0x00);
+	memcpy(primaryRegion.data(), &protectiveMBR, sizeof(mdfs::mbr::MBR));
+	memcpy(primaryRegion.data() + info.sectorSize, &gptPrimaryHeader, sizeof(mdfs::HeaderGPT));
+	std::vector<char> backupRegion(totalGptSize, 0x00);
+	memcpy(backupRegion.data() + totalGptSize - info.sectorSize, &gptBackupHeader, sizeof(mdfs::HeaderGPT));
+
+	mdfs::WriteBatch batch;
+	batch.add(0, primaryRegion.data(), totalGptLBA);
+	batch.add(disk.size_lba() - totalGptLBA, backupRegion.data(), totalGptLBA);
+	disk.submit(batch);
 
 	disk.close();
 	return mdfs::Result::SUCCESS;
@@ -265,13 +264,9 @@ static mdfs::Result make_mbr_partition_table(const mdfs::InitpartRunInfo &info)
 	// disk.seekp(0, std::ios::end);
 	// size_t diskSize = mdfs::align_down<size_t>(disk.tellp(), info.sectorSize.value());
 
-	mdfs::BlockDevice disk(info.inFile);
+	mdfs::BlockDevice disk(info.inFile, 512, std::ios::in | std::ios::out, info.io);
 
-	std::vector<char> zeros(disk.size_b(), 0x00);
-	if (info.clearAll) {
-		disk.seekp(0);
-		disk.write((char *) zeros.data(), zeros.size());
-	}
+	if (info.clearAll) { disk.zero_range(0, disk.size_lba()); }
 
 	disk.seekp(0);
 	disk.write((char *) &mbr, sizeof(mdfs::mbr::MBR));
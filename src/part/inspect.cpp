@@ -0,0 +1,157 @@
+#include <algorithm>
+#include <common/block_device.hpp>
+#include <common/gpt.hpp>
+#include <common/table_reader.hpp>
+#include <common/units.hpp>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <part/format.hpp>
+#include <part/inspect.hpp>
+#include <part/io_options.hpp>
+#include <sstream>
+
+CLI::App *mdfs::make_inspect_app(mdfs::InspectInfo &info, CLI::App &app) {
+	CLI::App *inspect = app.add_subcommand("inspect", "Prints the partition tables of a disk image");
+	inspect->add_option("-i,--img", info.inFile, "Disk image to inspect")->required();
+	inspect->add_option("-s,--sector_size", info.sectorSize, "Sector size to use")->default_str("Auto detect");
+	inspect->add_option("-f,--format", info.format, "Output format")
+			->check(CLI::IsMember({"text", "json"}))
+			->default_str("text");
+	mdfs::add_io_options(inspect, info.io);
+	inspect->get_option("--io-engine")->default_str("mmap");
+	return inspect;
+}
+
+static void print_text(const std::string &path, mdfs::BlockDevice &disk, const mdfs::PartitionTableReader &reader) {
+	const mdfs::GptCopy *gpt = reader.active();
+	std::cout << std::left << std::setw(20) << "Disk image:" << path << "\n"
+			  << std::setw(20) << "Image size:" << mdfs::size_string(disk.size_b()) << ", " << disk.size_lba()
+			  << " sectors of " << disk.block_size() << " bytes\n"
+			  << std::setw(20) << "Table:"
+			  << (gpt ? "GPT" : (reader.has_mbr_signature() ? "MBR" : "none")) << "\n";
+	if (reader.has_mbr_signature() && gpt) {
+		std::cout << std::setw(20) << "Protective MBR:" << (reader.has_protective_mbr() ? "yes" : "no") << "\n";
+	}
+	std::cout << std::setw(20) << "Primary GPT:" << "LBA " << reader.primary().headerLBA << ", "
+			  << mdfs::gpt_status_name(reader.primary().status) << "\n"
+			  << std::setw(20) << "Backup GPT:" << "LBA " << reader.backup().headerLBA << ", "
+			  << mdfs::gpt_status_name(reader.backup().status) << "\n";
+
+	if (gpt) {
+		const mdfs::HeaderGPT &header = *gpt->header;
+		size_t used = 0;
+		for ([[maybe_unused]] auto entry : gpt->used_entries()) { used++; }
+		std::cout << std::setw(20) << "Disk GUID:" << mdfs::guid_string(header.diskGUID) << "\n"
+				  << std::setw(20) << "Usable LBAs:" << header.firstUsableLBA << " - " << header.lastUsableLBA << "\n"
+				  << std::setw(20) << "Entry array:" << header.numberOfPartitionEntries << " entries of "
+				  << header.sizeOfPartitionEntries << " bytes at LBA " << header.partitionEntryLBA << "\n"
+				  << std::setw(20) << "Partitions:" << used << "\n";
+		if (used == 0) { return; }
+
+		std::cout << "\n"
+				  << std::right << std::setw(5) << "#" << std::setw(14) << "First LBA" << std::setw(14) << "Last LBA"
+				  << std::setw(12) << "Size" << "  " << std::left << std::setw(38) << "Type GUID" << std::setw(38)
+				  << "Unique GUID" << std::setw(20) << "Attributes" << "Name\n";
+		for (auto [index, entry] : gpt->used_entries()) {
+			uint64_t sectors = entry->endingLBA >= entry->startingLBA ? entry->endingLBA - entry->startingLBA + 1 : 0;
+			std::ostringstream attributes;
+			attributes << "0x" << std::hex << std::setfill('0') << std::setw(16) << entry->attributes;
+			std::cout << std::right << std::setw(5) << index + 1 << std::setw(14) << entry->startingLBA
+					  << std::setw(14) << entry->endingLBA << std::setw(12)
+					  << mdfs::size_string(mdfs::lba_to_addr(sectors, disk.block_size())) << "  " << std::left
+					  << std::setw(38) << mdfs::guid_string(entry->partitionTypeGUID) << std::setw(38)
+					  << mdfs::guid_string(entry->uniquePartitionGUID) << std::setw(20) << attributes.str()
+					  << mdfs::gpt_partition_name(*entry) << "\n";
+		}
+		return;
+	}
+
+	if (!reader.has_mbr_signature()) { return; }
+	std::cout << std::setw(20) << "Disk signature:" << "0x" << std::right << std::hex << std::setfill('0')
+			  << std::setw(8) << reader.mbr().RDiskSignature << std::setfill(' ') << std::dec << "\n";
+	const mdfs::mbr::PartitionRecord *records = reader.mbr().partitionRecords;
+	if (std::all_of(records, records + 4, [](const auto &record) { return record.OSType == 0x00; })) { return; }
+	std::cout << "\n" << std::setw(5) << "#" << std::setw(6) << "Boot" << std::setw(6) << "Type"
+			  << std::setw(14) << "First LBA" << std::setw(14) << "Sectors" << std::setw(12) << "Size" << "\n";
+	for (size_t i = 0; i < 4; i++) {
+		const mdfs::mbr::PartitionRecord &record = reader.mbr().partitionRecords[i];
+		if (record.OSType == 0x00) { continue; }
+		std::cout << std::setw(5) << i + 1 << std::setw(6) << (record.bootIndicator == 0x80 ? "*" : "")
+				  << std::setw(4) << "0x" << std::hex << std::setfill('0') << std::setw(2) << +record.OSType
+				  << std::setfill(' ') << std::dec << std::setw(14) << record.startingLBA << std::setw(14)
+				  << record.sizeInLBA << std::setw(12)
+				  << mdfs::size_string(mdfs::lba_to_addr(record.sizeInLBA, disk.block_size())) << "\n";
+	}
+}
+
+static void print_json(const std::string &path, mdfs::BlockDevice &disk, const mdfs::PartitionTableReader &reader) {
+	std::ostringstream out;
+	out << "{\"image\":" << mdfs::json_string(path) << ",\"size\":" << disk.size_b()
+		<< ",\"sectorSize\":" << disk.block_size() << ",\"mbr\":";
+	if (reader.has_mbr_signature()) {
+		out << "{\"protective\":" << (reader.has_protective_mbr() ? "true" : "false")
+			<< ",\"diskSignature\":" << reader.mbr().RDiskSignature << ",\"records\":[";
+		bool first = true;
+		for (size_t i = 0; i < 4; i++) {
+			const mdfs::mbr::PartitionRecord &record = reader.mbr().partitionRecords[i];
+			if (record.OSType == 0x00) { continue; }
+			out << (first ? "" : ",") << "{\"index\":" << i + 1 << ",\"boot\":"
+				<< (record.bootIndicator == 0x80 ? "true" : "false") << ",\"type\":" << +record.OSType
+				<< ",\"firstLBA\":" << record.startingLBA << ",\"sizeInLBA\":" << record.sizeInLBA << "}";
+			first = false;
+		}
+		out << "]}";
+	} else {
+		out << "null";
+	}
+
+	out << ",\"primary\":{\"lba\":" << reader.primary().headerLBA << ",\"status\":"
+		<< mdfs::json_string(mdfs::gpt_status_name(reader.primary().status)) << "},\"backup\":{\"lba\":"
+		<< reader.backup().headerLBA << ",\"status\":" << mdfs::json_string(mdfs::gpt_status_name(reader.backup().status))
+		<< "},\"gpt\":";
+	const mdfs::GptCopy *gpt = reader.active();
+	if (gpt) {
+		const mdfs::HeaderGPT &header = *gpt->header;
+		out << "{\"diskGUID\":\"" << mdfs::guid_string(header.diskGUID) << "\",\"firstUsableLBA\":" << header.firstUsableLBA
+			<< ",\"lastUsableLBA\":" << header.lastUsableLBA << ",\"entryLBA\":" << header.partitionEntryLBA
+			<< ",\"entryCount\":" << header.numberOfPartitionEntries << ",\"entrySize\":"
+			<< header.sizeOfPartitionEntries << ",\"partitions\":[";
+		bool first = true;
+		for (auto [index, entry] : gpt->used_entries()) {
+			out << (first ? "" : ",") << "{\"index\":" << index + 1 << ",\"type\":\""
+				<< mdfs::guid_string(entry->partitionTypeGUID) << "\",\"guid\":\"" << mdfs::guid_string(entry->uniquePartitionGUID)
+				<< "\",\"firstLBA\":" << entry->startingLBA << ",\"lastLBA\":" << entry->endingLBA
+				<< ",\"attributes\":" << entry->attributes << ",\"name\":" << mdfs::json_string(mdfs::gpt_partition_name(*entry))
+				<< "}";
+			first = false;
+		}
+		out << "]}";
+	} else {
+		out << "null";
+	}
+	out << "}\n";
+	std::cout << out.str();
+}
+
+int mdfs::do_inspect(mdfs::InspectInfo &info, const CLI::App *app) {
+	if (!std::filesystem::exists(info.inFile)) {
+		std::cerr << "Specified disk image doesn't exist.\n";
+		return EXIT_FAILURE;
+	}
+
+	mdfs::BlockDevice disk(info.inFile, info.sectorSize ? info.sectorSize : 512, std::ios::in, info.io);
+	mdfs::PartitionTableReader reader(disk);
+	mdfs::Result result = app->count("--sector_size") ? reader.read() : reader.read_detecting_sector_size();
+	if (result != mdfs::Result::SUCCESS) {
+		std::cerr << "Disk image is too small to hold a partition table.\n";
+		return EXIT_FAILURE;
+	}
+
+	if (info.format == "json") {
+		print_json(info.inFile, disk, reader);
+	} else {
+		print_text(info.inFile, disk, reader);
+	}
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,45 @@
+#include <atomic>
+#include <iostream>
+#include <memory>
+#include <part/io_options.hpp>
+
+namespace {
+// throttles the progress line, which is ended once the last copy of the callback is gone
+struct ProgressState {
+	std::atomic<uint64_t> lastReported = 0;
+	std::atomic<bool> printed = false;
+
+	~ProgressState() {
+		if (printed) { std::cerr << "\n"; }
+	}
+};
+}// namespace
+
+void mdfs::add_io_options(CLI::App *app, mdfs::IoEngineOptions &options) {
+	app->add_option("--io-engine", options.engine, "I/O engine used to access the disk image")
+			->check(CLI::IsMember(mdfs::io_engine_names()))
+			->default_str(MDFS_DEFAULT_IO_ENGINE);
+	app->add_option("--io-depth", options.queueDepth,
+					"Number of requests kept in flight. Only used by asynchronous engines")
+			->check(CLI::Range(1, 4096))
+			->default_val(32);
+	app->add_option("--io-size", options.requestSize,
+					"Size of a single I/O request, accepts unit suffixes. Only used by asynchronous engines")
+			->transform(CLI::AsSizeValue(false))
+			->default_str("1M");
+	app->add_flag("--direct", options.direct,
+				  "Open the image with O_DIRECT, bypassing the page cache. Requires an engine working on file "
+				  "descriptors, like io_uring");
+	app->add_flag_callback("--progress", [&options]() {
+		// shared by every copy of the callback, and so by every engine and thread reporting through it
+		auto state = std::make_shared<ProgressState>();
+		options.progress = [state](uint64_t done) {
+			uint64_t last = state->lastReported.load();
+			if (done - last < 64 * mdfs::units::mb && done > last) { return; }
+			if (!state->lastReported.compare_exchange_strong(last, done)) { return; }
+			state->printed = true;
+			std::cerr << "\r" << done / mdfs::units::mb << " MiB done" << std::flush;
+		};
+	}, "Report the amount of data transferred as I/O completes. Only the posix and io_uring engines report, "
+	   "the mmap and fstream engines print nothing");
+}
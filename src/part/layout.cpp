@@ -0,0 +1,357 @@
+#include <algorithm>
+#include <charconv>
+#include <common/align.hpp>
+#include <common/crc32.hpp>
+#include <common/free_space.hpp>
+#include <common/gpt.hpp>
+#include <common/gpt_editor.hpp>
+#include <common/mbr.hpp>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <part/format.hpp>
+#include <part/layout.hpp>
+#include <random>
+#include <stdexcept>
+#include <strings.h>
+
+namespace {
+struct LayoutLine {
+	size_t number;
+	std::vector<std::string> tokens;
+};
+}// namespace
+
+[[noreturn]] static void fail(size_t line, const std::string &message) {
+	throw std::runtime_error("line " + std::to_string(line) + ": " + message);
+}
+
+// whitespace separated tokens, double quotes group a token and take \" and \\ escapes. a # outside of quotes starts
+// a comment
+static std::vector<std::string> tokenize(const std::string &line, size_t number) {
+	std::vector<std::string> tokens;
+	std::string token;
+	bool inToken = false;
+	bool quoted = false;
+	for (size_t i = 0; i < line.size(); i++) {
+		char c = line[i];
+		if (quoted) {
+			if (c == '\\' && i + 1 < line.size() && (line[i + 1] == '"' || line[i + 1] == '\\')) {
+				token.push_back(line[++i]);
+			} else if (c == '"') {
+				quoted = false;
+			} else {
+				token.push_back(c);
+			}
+		} else if (c == '"') {
+			quoted = true;
+			inToken = true;
+		} else if (c == '#') {
+			break;
+		} else if (isspace(uint8_t(c))) {
+			if (inToken) { tokens.push_back(std::move(token)); }
+			token.clear();
+			inToken = false;
+		} else {
+			token.push_back(c);
+			inToken = true;
+		}
+	}
+	if (quoted) { fail(number, "unterminated quote"); }
+	if (inToken) { tokens.push_back(std::move(token)); }
+	return tokens;
+}
+
+// decimal, or hexadecimal with a 0x prefix
+static uint64_t parse_number(const std::string &str, size_t line, const char *what) {
+	int base = 10;
+	const char *begin = str.data();
+	if (str.size() > 2 && str[0] == '0' && (str[1] == 'x' || str[1] == 'X')) {
+		base = 16;
+		begin += 2;
+	}
+	uint64_t value = 0;
+	auto [end, error] = std::from_chars(begin, str.data() + str.size(), value, base);
+	if (error != std::errc() || end != str.data() + str.size()) { fail(line, std::string("invalid ") + what); }
+	return value;
+}
+
+static GUID parse_guid(const std::string &str, size_t line) {
+	GUID guid;
+	if (!parse_uuid(str, &guid)) { fail(line, "invalid GUID \"" + str + "\""); }
+	return guid;
+}
+
+static mdfs::LayoutPartition parse_partition(const mdfs::Layout &layout, const LayoutLine &line) {
+	mdfs::LayoutPartition partition;
+	partition.type = GPT_LINUX_FILESYSTEM_DATA_GUID;
+	bool gpt = layout.type == mdfs::PartType::GPT;
+	for (size_t i = 1; i < line.tokens.size(); i++) {
+		const std::string &token = line.tokens[i];
+		size_t equals = token.find('=');
+		std::string key = token.substr(0, equals);
+		std::string value = equals == std::string::npos ? "" : token.substr(equals + 1);
+		if (key == "bootable" && equals == std::string::npos) {
+			if (gpt) { fail(line.number, "bootable is only valid for MBR"); }
+			partition.bootable = true;
+			continue;
+		}
+		if (equals == std::string::npos) { fail(line.number, "expected key=value, got \"" + token + "\""); }
+
+		if (key == "size") {
+			if (value == "rest") { continue; }
+			std::optional<uint64_t> bytes = mdfs::parse_size(value, layout.sectorSize);
+			if (!bytes || *bytes == 0) { fail(line.number, "invalid size \"" + value + "\""); }
+			partition.sizeInLBA = (*bytes + layout.sectorSize - 1) / layout.sectorSize;
+		} else if (key == "start") {
+			partition.startingLBA = parse_number(value, line.number, "start");
+		} else if (key == "type" && gpt) {
+			std::optional<GUID> type = mdfs::parse_gpt_type(value);
+			if (!type) { fail(line.number, "invalid partition type \"" + value + "\""); }
+			partition.type = *type;
+		} else if (key == "type") {
+			std::optional<uint8_t> type = mdfs::parse_mbr_type(value);
+			if (!type) { fail(line.number, "invalid partition type \"" + value + "\""); }
+			partition.OSType = *type;
+		} else if (key == "source") {
+			if (value.empty()) { fail(line.number, "source needs a file"); }
+			partition.source = value;
+		} else if (key == "name" || key == "attributes" || key == "guid") {
+			if (!gpt) { fail(line.number, key + " is only valid for GPT"); }
+			if (key == "name") {
+				mdfs::PartitionEntryGPT scratch;
+				if (mdfs::set_gpt_partition_name(scratch, value) != mdfs::Result::SUCCESS) {
+					fail(line.number, "partition names have to be valid UTF-8 and fit in 36 UTF-16 code units");
+				}
+				partition.name = value;
+			} else if (key == "attributes") {
+				partition.attributes = parse_number(value, line.number, "attributes");
+			} else {
+				partition.guid = parse_guid(value, line.number);
+			}
+		} else {
+			fail(line.number, "unknown partition key \"" + key + "\"");
+		}
+	}
+	return partition;
+}
+
+mdfs::Layout mdfs::parse_layout(std::istream &in) {
+	// partitions and the alignment depend on the table type and sector size, which may come after them, so they
+	// are parsed once every setting is known
+	Layout layout;
+	std::vector<LayoutLine> partitionLines;
+	std::optional<LayoutLine> alignLine;
+	std::string text;
+	for (size_t number = 1; std::getline(in, text); number++) {
+		LayoutLine line = {number, tokenize(text, number)};
+		if (line.tokens.empty()) { continue; }
+		const std::string &key = line.tokens[0];
+		if (key == "partition") {
+			partitionLines.push_back(std::move(line));
+			continue;
+		}
+		if (line.tokens.size() != 2) { fail(number, key + " takes exactly one value"); }
+		const std::string &value = line.tokens[1];
+
+		if (key == "table") {
+			if (strcasecmp(value.c_str(), "gpt") == 0) {
+				layout.type = PartType::GPT;
+			} else if (strcasecmp(value.c_str(), "mbr") == 0) {
+				layout.type = PartType::MBR;
+			} else {
+				fail(number, "table has to be gpt or mbr");
+			}
+		} else if (key == "sector-size") {
+			layout.sectorSize = parse_number(value, number, "sector size");
+			if (layout.sectorSize < 512 || (layout.sectorSize & (layout.sectorSize - 1)) != 0) {
+				fail(number, "the sector size has to be a power of two of at least 512");
+			}
+		} else if (key == "disk-guid") {
+			layout.diskGUID = value == "random" ? std::nullopt : std::optional<GUID>(parse_guid(value, number));
+		} else if (key == "entries") {
+			uint64_t count = parse_number(value, number, "entry count");
+			if (count == 0 || count > UINT32_MAX / sizeof(PartitionEntryGPT)) { fail(number, "invalid entry count"); }
+			layout.entryCount = uint32_t(count);
+		} else if (key == "disk-signature") {
+			uint64_t signature = value == "random" ? 0 : parse_number(value, number, "disk signature");
+			if (signature > UINT32_MAX) { fail(number, "the disk signature has to fit in 32 bits"); }
+			layout.diskSignature = value == "random" ? std::nullopt : std::optional<uint32_t>(signature);
+		} else if (key == "align") {
+			alignLine = std::move(line);
+		} else {
+			fail(number, "unknown setting \"" + key + "\"");
+		}
+	}
+
+	if (alignLine) {
+		std::optional<uint64_t> alignment = parse_size(alignLine->tokens[1], layout.sectorSize);
+		if (!alignment) { fail(alignLine->number, "invalid alignment \"" + alignLine->tokens[1] + "\""); }
+		layout.alignment = *alignment;
+	}
+	size_t rest = 0;
+	for (const LayoutLine &line : partitionLines) {
+		layout.partitions.push_back(parse_partition(layout, line));
+		if (!layout.partitions.back().sizeInLBA && !layout.partitions.back().startingLBA && rest++) {
+			fail(line.number, "only one partition can take the rest of the disk");
+		}
+	}
+	size_t maxPartitions = layout.type == PartType::GPT ? layout.entryCount : 4;
+	if (layout.partitions.size() > maxPartitions) {
+		fail(partitionLines[maxPartitions].number, "the table only has room for " + std::to_string(maxPartitions) +
+															" partitions");
+	}
+	return layout;
+}
+
+mdfs::Layout mdfs::read_layout_file(const std::string &path) {
+	if (path == "-") { return parse_layout(std::cin); }
+	std::ifstream in(path);
+	if (!in) { throw std::runtime_error("could not open the layout file"); }
+	return parse_layout(in);
+}
+
+// sized partitions with a start are reserved first, then the other sized ones are placed in order, and the ones
+// without a size take the remaining free extent they start in, or the largest one
+static std::vector<mdfs::PlacedPartition> place_partitions(const mdfs::Layout &layout, uint64_t firstUsable,
+														   uint64_t lastUsable) {
+	mdfs::FreeSpaceMap map(firstUsable, lastUsable);
+	uint64_t alignment = std::max<uint64_t>(1, layout.alignment / layout.sectorSize);
+	std::vector<mdfs::PlacedPartition> placed(layout.partitions.size());
+	auto place = [&](uint32_t index, uint64_t first, uint64_t last) {
+		if (map.reserve(first, last) != mdfs::Result::SUCCESS) {
+			throw std::runtime_error("partition " + std::to_string(index + 1) + " doesn't fit at LBA " +
+									 std::to_string(first));
+		}
+		placed[index] = {index, first, last};
+	};
+	auto no_room = [](uint32_t index) -> std::runtime_error {
+		return std::runtime_error("no free space left for partition " + std::to_string(index + 1));
+	};
+
+	for (uint32_t i = 0; i < layout.partitions.size(); i++) {
+		const mdfs::LayoutPartition &partition = layout.partitions[i];
+		if (!partition.startingLBA || !partition.sizeInLBA) { continue; }
+		place(i, *partition.startingLBA, *partition.startingLBA + *partition.sizeInLBA - 1);
+	}
+	for (uint32_t i = 0; i < layout.partitions.size(); i++) {
+		const mdfs::LayoutPartition &partition = layout.partitions[i];
+		if (partition.startingLBA || !partition.sizeInLBA) { continue; }
+		std::optional<uint64_t> first = map.find(*partition.sizeInLBA, alignment, mdfs::Fit::FIRST);
+		if (!first) { throw no_room(i); }
+		place(i, *first, *first + *partition.sizeInLBA - 1);
+	}
+	for (uint32_t i = 0; i < layout.partitions.size(); i++) {
+		const mdfs::LayoutPartition &partition = layout.partitions[i];
+		if (partition.sizeInLBA) { continue; }
+		std::optional<mdfs::FreeSpaceMap::Extent> free =
+				partition.startingLBA ? map.extent_at(*partition.startingLBA) : map.largest(alignment);
+		if (!free) { throw no_room(i); }
+		place(i, partition.startingLBA.value_or(free->first), free->last);
+	}
+	return placed;
+}
+
+static mdfs::LayoutTables build_gpt(const mdfs::Layout &layout, uint64_t sizeInLBA) {
+	size_t sectorSize = layout.sectorSize;
+	size_t entryBytes = size_t(layout.entryCount) * sizeof(mdfs::PartitionEntryGPT);
+	size_t totalGptLBA = mdfs::align_up<size_t>(sectorSize * 2 + entryBytes, sectorSize) / sectorSize;
+	if (sizeInLBA < totalGptLBA * 2 + 1) { throw std::runtime_error("image is too small for the GPT"); }
+
+	// same geometry as initpart
+	mdfs::LayoutTables tables;
+	uint64_t firstUsable = totalGptLBA;
+	uint64_t lastUsable = sizeInLBA - totalGptLBA;
+	tables.partitions = place_partitions(layout, firstUsable, lastUsable);
+
+	// every random GUID comes out of one call
+	size_t randomCount = layout.diskGUID ? 0 : 1;
+	for (const mdfs::LayoutPartition &partition : layout.partitions) { randomCount += partition.guid ? 0 : 1; }
+	std::vector<GUID> random(randomCount);
+	if (randomCount && gen_random_UUIDv4(random.data(), randomCount) != mdfs::Result::SUCCESS) {
+		throw std::runtime_error("could not generate GUIDs");
+	}
+	size_t nextRandom = 0;
+
+	tables.primary.assign(totalGptLBA * sectorSize, std::byte(0));
+	mdfs::mbr::MBR protectiveMBR = mdfs::build_protective_mbr(sizeInLBA * sectorSize, sectorSize);
+	memcpy(tables.primary.data(), &protectiveMBR, sizeof(protectiveMBR));
+
+	std::byte *entries = tables.primary.data() + sectorSize * 2;
+	for (const mdfs::PlacedPartition &placed : tables.partitions) {
+		const mdfs::LayoutPartition &partition = layout.partitions[placed.index];
+		mdfs::PartitionEntryGPT entry = {};
+		entry.partitionTypeGUID = partition.type;
+		entry.uniquePartitionGUID = partition.guid ? *partition.guid : random[nextRandom++];
+		entry.startingLBA = placed.firstLBA;
+		entry.endingLBA = placed.lastLBA;
+		entry.attributes = partition.attributes;
+		mdfs::set_gpt_partition_name(entry, partition.name);
+		memcpy(entries + size_t(placed.index) * sizeof(entry), &entry, sizeof(entry));
+	}
+
+	// the backup entry array is copied and checksummed in one pass
+	tables.backupLBA = lastUsable + 1;
+	tables.backup.assign((totalGptLBA - 1) * sectorSize, std::byte(0));
+	crc32_t entriesCRC = mdfs::copy_and_crc(tables.backup.data(), entries, entryBytes);
+
+	mdfs::HeaderGPT header = {.signature = GPT_SIGNATURE,
+							  .revision = GPT_REVISION_01,
+							  .headerSize = sizeof(mdfs::HeaderGPT),
+							  .headerCRC32 = 0,
+							  .reserved = {0, 0, 0, 0},
+							  .myLBA = 1,
+							  .alternateLBA = sizeInLBA - 1,
+							  .firstUsableLBA = firstUsable,
+							  .lastUsableLBA = lastUsable,
+							  .diskGUID = layout.diskGUID ? *layout.diskGUID : random[nextRandom++],
+							  .partitionEntryLBA = 2,
+							  .numberOfPartitionEntries = layout.entryCount,
+							  .sizeOfPartitionEntries = sizeof(mdfs::PartitionEntryGPT),
+							  .partitionEntryArrayCRC32 = entriesCRC};
+	header.headerCRC32 = mdfs::crc32(&header, sizeof(header));
+	memcpy(tables.primary.data() + sectorSize, &header, sizeof(header));
+
+	header.headerCRC32 = 0;
+	header.myLBA = sizeInLBA - 1;
+	header.alternateLBA = 1;
+	header.partitionEntryLBA = tables.backupLBA;
+	header.headerCRC32 = mdfs::crc32(&header, sizeof(header));
+	memcpy(tables.backup.data() + tables.backup.size() - sectorSize, &header, sizeof(header));
+	return tables;
+}
+
+static mdfs::LayoutTables build_mbr(const mdfs::Layout &layout, uint64_t sizeInLBA) {
+	if (sizeInLBA < 2) { throw std::runtime_error("image is too small for an MBR"); }
+	mdfs::LayoutTables tables;
+	tables.partitions = place_partitions(layout, 1, std::min<uint64_t>(sizeInLBA - 1, UINT32_MAX));
+
+	mdfs::mbr::MBR mbr;
+	memset(&mbr.bootCode, 0xF4, sizeof(mbr.bootCode));
+	memcpy(&mbr.bootCode, mdfs::mbr::prot_mbr_code, sizeof(mdfs::mbr::prot_mbr_code));
+	if (layout.diskSignature) {
+		mbr.RDiskSignature = *layout.diskSignature;
+	} else {
+		std::random_device rd;
+		mbr.RDiskSignature = rd();
+	}
+	memset(&mbr.partitionRecords, 0x00, sizeof(mbr.partitionRecords));
+	for (const mdfs::PlacedPartition &placed : tables.partitions) {
+		const mdfs::LayoutPartition &partition = layout.partitions[placed.index];
+		mbr.partitionRecords[placed.index] = {.bootIndicator = uint8_t(partition.bootable ? 0x80 : 0x00),
+											  .startingCHS = {0xFE, 0xFF, 0xFF},
+											  .OSType = partition.OSType,
+											  .endingCHS = {0xFE, 0xFF, 0xFF},
+											  .startingLBA = uint32_t(placed.firstLBA),
+											  .sizeInLBA = uint32_t(placed.lastLBA - placed.firstLBA + 1)};
+	}
+
+	tables.primary.assign(layout.sectorSize, std::byte(0));
+	memcpy(tables.primary.data(), &mbr, sizeof(mbr));
+	tables.backupLBA = sizeInLBA;
+	return tables;
+}
+
+mdfs::LayoutTables mdfs::build_layout(const Layout &layout, uint64_t sizeInLBA) {
+	return layout.type == PartType::GPT ? build_gpt(layout, sizeInLBA) : build_mbr(layout, sizeInLBA);
+}
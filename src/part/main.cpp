@@ -4,7 +4,15 @@
 #include <cstring>
 #include <filesystem>
 #include <iostream>
+#include <part/apply.hpp>
+#include <part/clone.hpp>
+#include <part/create.hpp>
+#include <part/delta.hpp>
 #include <part/initpart.hpp>
+#include <part/inspect.hpp>
+#include <part/part.hpp>
+#include <part/stream.hpp>
+#include <part/verify.hpp>
 #include <part/licenses.hpp>
 #include <random>
 #include <strings.h>
@@ -17,10 +25,37 @@ int main(int argc, char **argv) {
 
 	mdfs::InitPartInfo initpartInfo;
 	CLI::App *initpart = mdfs::make_initpart_app(initpartInfo, app);
+	mdfs::InspectInfo inspectInfo;
+	CLI::App *inspect = mdfs::make_inspect_app(inspectInfo, app);
+	mdfs::VerifyInfo verifyInfo;
+	CLI::App *verify = mdfs::make_verify_app(verifyInfo, app);
+	mdfs::PartInfo partInfo;
+	CLI::App *part = mdfs::make_part_app(partInfo, app);
+	mdfs::ApplyInfo applyInfo;
+	CLI::App *apply = mdfs::make_apply_app(applyInfo, app);
+	mdfs::StreamInfo streamInfo;
+	CLI::App *stream = mdfs::make_stream_app(streamInfo, app);
+	mdfs::CreateInfo createInfo;
+	CLI::App *create = mdfs::make_create_app(createInfo, app);
+	mdfs::CloneInfo cloneInfo;
+	CLI::App *clone = mdfs::make_clone_app(cloneInfo, app);
+	mdfs::DiffInfo diffInfo;
+	CLI::App *diff = mdfs::make_diff_app(diffInfo, app);
+	mdfs::PatchInfo patchInfo;
+	CLI::App *patch = mdfs::make_patch_app(patchInfo, app);
 
 	CLI11_PARSE(app, argc, argv);
 
 	if (initpart->parsed()) { return mdfs::do_initpart(initpartInfo, initpart); }
+	if (inspect->parsed()) { return mdfs::do_inspect(inspectInfo, inspect); }
+	if (verify->parsed()) { return mdfs::do_verify(verifyInfo, verify); }
+	if (part->parsed()) { return mdfs::do_part(partInfo, part); }
+	if (apply->parsed()) { return mdfs::do_apply(applyInfo, apply); }
+	if (stream->parsed()) { return mdfs::do_stream(streamInfo, stream); }
+	if (create->parsed()) { return mdfs::do_create(createInfo, create); }
+	if (clone->parsed()) { return mdfs::do_clone(cloneInfo, clone); }
+	if (diff->parsed()) { return mdfs::do_diff(diffInfo, diff); }
+	if (patch->parsed()) { return mdfs::do_patch(patchInfo, patch); }
 
 	return EXIT_SUCCESS;
 }
\ No newline at end of file
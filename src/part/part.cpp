@@ -0,0 +1,344 @@
+#include <algorithm>
+#include <common/block_device.hpp>
+#include <common/free_space.hpp>
+#include <common/gpt.hpp>
+#include <common/gpt_editor.hpp>
+#include <common/guid.hpp>
+#include <common/mbr.hpp>
+#include <common/table_reader.hpp>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <optional>
+#include <part/format.hpp>
+#include <part/io_options.hpp>
+#include <part/part.hpp>
+#include <vector>
+
+static void add_common_options(CLI::App *app, mdfs::PartInfo &info) {
+	app->add_option("-i,--img", info.inFile, "Disk image to modify")->required();
+	app->add_option("-s,--sector_size", info.sectorSize, "Sector size to use")->default_str("Auto detect");
+	mdfs::add_io_options(app, info.io);
+}
+
+CLI::App *mdfs::make_part_app(mdfs::PartInfo &info, CLI::App &app) {
+	CLI::App *part = app.add_subcommand("part", "Adds, deletes and resizes the partitions of a disk image");
+	part->require_subcommand(1);
+
+	CLI::App *add = part->add_subcommand("add", "Adds a partition in free space");
+	add_common_options(add, info);
+	add->add_option("-p,--partition", info.index, "Number of the entry to use")->default_str("First unused");
+	add->add_option("--size", info.size, "Size of the partition, like 512M, 2GiB or 4096s")
+			->default_str("Largest free space");
+	add->add_option("--start", info.start, "First LBA of the partition")->default_str("Placed by --fit");
+	add->add_option("--align", info.alignment, "Boundary the first LBA is aligned to")->default_str("1M");
+	add->add_option("--fit", info.fit, "Free space to place the partition in, the first one or the smallest one")
+			->check(CLI::IsMember({"first", "best"}))
+			->default_str("first");
+	add->add_option("-t,--type", info.type,
+					"Partition type. A GUID, efi or linux for GPT, a hexadecimal OS type for MBR")
+			->default_str("linux, 83");
+	add->add_option("-n,--name", info.name, "Partition name. This option is only valid for GPT");
+	add->add_option("--attributes", info.attributes, "Attribute bits. This option is only valid for GPT")
+			->default_str("0");
+
+	CLI::App *del = part->add_subcommand("delete", "Deletes a partition");
+	add_common_options(del, info);
+	del->add_option("-p,--partition", info.index, "Number of the partition to delete")->required();
+
+	CLI::App *resize = part->add_subcommand("resize", "Moves the end of a partition");
+	add_common_options(resize, info);
+	resize->add_option("-p,--partition", info.index, "Number of the partition to resize")->required();
+	resize->add_option("--size", info.size, "New size of the partition, like 512M, 2GiB or 4096s")->required();
+	return part;
+}
+
+namespace {
+struct Extent {
+	uint64_t first;
+	uint64_t last;
+};
+
+enum class Operation { ADD, DELETE, RESIZE };
+}// namespace
+
+// partitions may overlap or stick out of the usable range, so they are clamped to it and merged before being
+// reserved, which leaves the map with exactly the sectors no partition covers
+static mdfs::FreeSpaceMap make_free_space_map(std::vector<Extent> used, uint64_t firstUsable, uint64_t lastUsable) {
+	mdfs::FreeSpaceMap map(firstUsable, lastUsable);
+	std::sort(used.begin(), used.end(), [](const Extent &a, const Extent &b) { return a.first < b.first; });
+	std::optional<Extent> run;
+	for (const Extent &extent : used) {
+		Extent clamped = {std::max(extent.first, firstUsable), std::min(extent.last, lastUsable)};
+		if (clamped.first > clamped.last) { continue; }
+		if (run && clamped.first <= run->last + 1) {
+			run->last = std::max(run->last, clamped.last);
+			continue;
+		}
+		if (run) { map.reserve(run->first, run->last); }
+		run = clamped;
+	}
+	if (run) { map.reserve(run->first, run->last); }
+	return map;
+}
+
+static std::optional<uint64_t> size_in_lba(const std::string &expression, size_t sectorSize) {
+	std::optional<uint64_t> bytes = mdfs::parse_size(expression, sectorSize);
+	if (!bytes || *bytes == 0) {
+		std::cerr << "Invalid size \"" << expression << "\".\n";
+		return std::nullopt;
+	}
+	return (*bytes + sectorSize - 1) / sectorSize;
+}
+
+// sectors for a new partition, either where --start puts it or where the allocator finds room
+static std::optional<Extent> place(const mdfs::PartInfo &info, const CLI::App *app,
+								   const mdfs::FreeSpaceMap &map, size_t sectorSize) {
+	std::optional<uint64_t> sectors;
+	if (!info.size.empty()) {
+		sectors = size_in_lba(info.size, sectorSize);
+		if (!sectors) { return std::nullopt; }
+	}
+
+	if (app->count("--start")) {
+		std::optional<mdfs::FreeSpaceMap::Extent> free = map.extent_at(info.start);
+		if (!free || (sectors && free->last - info.start + 1 < *sectors)) {
+			std::cerr << "Not enough free space at LBA " << info.start << ".\n";
+			return std::nullopt;
+		}
+		return Extent{info.start, sectors ? info.start + *sectors - 1 : free->last};
+	}
+
+	std::optional<uint64_t> alignmentBytes = mdfs::parse_size(info.alignment, sectorSize);
+	if (!alignmentBytes) {
+		std::cerr << "Invalid alignment \"" << info.alignment << "\".\n";
+		return std::nullopt;
+	}
+	uint64_t alignment = std::max<uint64_t>(1, *alignmentBytes / sectorSize);
+	if (!sectors) {
+		std::optional<mdfs::FreeSpaceMap::Extent> largest = map.largest(alignment);
+		if (!largest) {
+			std::cerr << "No free space left.\n";
+			return std::nullopt;
+		}
+		return Extent{largest->first, largest->last};
+	}
+	mdfs::Fit fit = info.fit == "best" ? mdfs::Fit::BEST : mdfs::Fit::FIRST;
+	std::optional<uint64_t> first = map.find(*sectors, alignment, fit);
+	if (!first) {
+		std::cerr << "No free space for " << mdfs::size_string(*sectors * sectorSize) << " aligned to "
+				  << mdfs::size_string(alignment * sectorSize) << ".\n";
+		return std::nullopt;
+	}
+	return Extent{*first, *first + *sectors - 1};
+}
+
+// the new end of a partition that is resized, it can only grow into the free space right behind it
+static std::optional<Extent> resize_extent(const mdfs::PartInfo &info, Extent current, const mdfs::FreeSpaceMap &map,
+										   size_t sectorSize) {
+	std::optional<uint64_t> sectors = size_in_lba(info.size, sectorSize);
+	if (!sectors) { return std::nullopt; }
+	Extent resized = {current.first, current.first + *sectors - 1};
+	if (resized.last > current.last) {
+		std::optional<mdfs::FreeSpaceMap::Extent> free = map.extent_at(current.last + 1);
+		if (!free || resized.last > free->last) {
+			uint64_t maximum = (free ? free->last : current.last) - current.first + 1;
+			std::cerr << "Not enough free space after the partition, it can grow to at most "
+					  << mdfs::size_string(maximum * sectorSize) << ".\n";
+			return std::nullopt;
+		}
+	}
+	return resized;
+}
+
+static bool is_unused(const GUID &type) {
+	static const GUID unused = GPT_UNUSED_PARTITION_ENTRY_GUID;
+	return memcmp(&type, &unused, sizeof(GUID)) == 0;
+}
+
+static void print_extent(const char *action, uint32_t index, Extent extent, size_t sectorSize) {
+	std::cout << action << " partition " << index << ": LBA " << extent.first << " - " << extent.last << " ("
+			  << mdfs::size_string((extent.last - extent.first + 1) * sectorSize) << ")\n";
+}
+
+static int edit_gpt(const mdfs::PartInfo &info, const CLI::App *app, Operation operation, mdfs::BlockDevice &disk) {
+	mdfs::GptEditor editor(disk);
+	if (editor.load() != mdfs::Result::SUCCESS) {
+		std::cerr << "Could not load the GPT.\n";
+		return EXIT_FAILURE;
+	}
+	const mdfs::HeaderGPT &header = editor.header();
+	if (info.index > editor.entry_count()) {
+		std::cerr << "The GPT only has " << editor.entry_count() << " entries.\n";
+		return EXIT_FAILURE;
+	}
+
+	std::vector<Extent> used;
+	for (auto [index, entry] : editor.entries()) { used.push_back({entry->startingLBA, entry->endingLBA}); }
+	mdfs::FreeSpaceMap map = make_free_space_map(used, header.firstUsableLBA, header.lastUsableLBA);
+
+	uint32_t index = info.index ? info.index - 1 : 0;
+	bool unused = is_unused(editor.entry(index).partitionTypeGUID);
+	if (operation == Operation::ADD) {
+		if (info.index == 0) {
+			while (index < editor.entry_count() && !is_unused(editor.entry(index).partitionTypeGUID)) { index++; }
+			if (index == editor.entry_count()) {
+				std::cerr << "All " << editor.entry_count() << " entries of the GPT are in use.\n";
+				return EXIT_FAILURE;
+			}
+		} else if (!unused) {
+			std::cerr << "Partition " << info.index << " is already in use.\n";
+			return EXIT_FAILURE;
+		}
+	} else if (unused) {
+		std::cerr << "Partition " << info.index << " doesn't exist.\n";
+		return EXIT_FAILURE;
+	}
+
+	mdfs::PartitionEntryGPT entry = editor.entry(index);
+	if (operation == Operation::ADD) {
+		std::string type = info.type.empty() ? "linux" : info.type;
+		std::optional<GUID> typeGUID = mdfs::parse_gpt_type(type);
+		if (!typeGUID) {
+			std::cerr << "Invalid partition type \"" << type << "\".\n";
+			return EXIT_FAILURE;
+		}
+		entry.partitionTypeGUID = *typeGUID;
+		if (mdfs::set_gpt_partition_name(entry, info.name) != mdfs::Result::SUCCESS) {
+			std::cerr << "Partition names have to be valid UTF-8 and fit in 36 UTF-16 code units.\n";
+			return EXIT_FAILURE;
+		}
+		if (gen_random_UUIDv4(&entry.uniquePartitionGUID) != mdfs::Result::SUCCESS) {
+			std::cerr << "Could not generate a partition GUID.\n";
+			return EXIT_FAILURE;
+		}
+		std::optional<Extent> extent = place(info, app, map, disk.block_size());
+		if (!extent) { return EXIT_FAILURE; }
+		entry.startingLBA = extent->first;
+		entry.endingLBA = extent->last;
+		entry.attributes = info.attributes;
+		editor.set_entry(index, entry);
+	} else if (operation == Operation::DELETE) {
+		editor.clear_entry(index);
+	} else {
+		std::optional<Extent> extent =
+				resize_extent(info, {entry.startingLBA, entry.endingLBA}, map, disk.block_size());
+		if (!extent) { return EXIT_FAILURE; }
+		entry.endingLBA = extent->last;
+		editor.set_entry(index, entry);
+	}
+
+	editor.commit();
+	if (operation == Operation::DELETE) {
+		std::cout << "Deleted partition " << index + 1 << "\n";
+	} else {
+		print_extent(operation == Operation::ADD ? "Added" : "Resized", index + 1, {entry.startingLBA, entry.endingLBA},
+					 disk.block_size());
+	}
+	return EXIT_SUCCESS;
+}
+
+static int edit_mbr(const mdfs::PartInfo &info, const CLI::App *app, Operation operation, mdfs::BlockDevice &disk,
+					mdfs::mbr::MBR mbr) {
+	if (!info.name.empty() || info.attributes) {
+		std::cerr << "Names and attributes are only valid for GPT.\n";
+		return EXIT_FAILURE;
+	}
+	if (info.index > 4) {
+		std::cerr << "An MBR only has 4 partition records.\n";
+		return EXIT_FAILURE;
+	}
+
+	// LBA 0 holds the MBR, and the 32 bit records can't address anything past 2^32 - 1
+	std::vector<Extent> used;
+	for (const mdfs::mbr::PartitionRecord &record : mbr.partitionRecords) {
+		if (record.OSType == 0x00 || record.sizeInLBA == 0) { continue; }
+		used.push_back({record.startingLBA, uint64_t(record.startingLBA) + record.sizeInLBA - 1});
+	}
+	uint64_t lastLBA = std::min<uint64_t>(disk.size_lba() - 1, UINT32_MAX);
+	mdfs::FreeSpaceMap map = make_free_space_map(used, 1, lastLBA);
+
+	uint32_t index = info.index ? info.index - 1 : 0;
+	if (operation == Operation::ADD && info.index == 0) {
+		while (index < 4 && mbr.partitionRecords[index].OSType != 0x00) { index++; }
+		if (index == 4) {
+			std::cerr << "All 4 partition records of the MBR are in use.\n";
+			return EXIT_FAILURE;
+		}
+	} else if (operation == Operation::ADD && mbr.partitionRecords[index].OSType != 0x00) {
+		std::cerr << "Partition " << info.index << " is already in use.\n";
+		return EXIT_FAILURE;
+	} else if (operation != Operation::ADD && mbr.partitionRecords[index].OSType == 0x00) {
+		std::cerr << "Partition " << info.index << " doesn't exist.\n";
+		return EXIT_FAILURE;
+	}
+
+	mdfs::mbr::PartitionRecord &record = mbr.partitionRecords[index];
+	Extent extent = {record.startingLBA, uint64_t(record.startingLBA) + record.sizeInLBA - 1};
+	if (operation == Operation::ADD) {
+		std::string type = info.type.empty() ? "83" : info.type;
+		std::optional<uint8_t> OSType = mdfs::parse_mbr_type(type);
+		if (!OSType) {
+			std::cerr << "Invalid partition type \"" << type << "\", MBR types are a hexadecimal byte.\n";
+			return EXIT_FAILURE;
+		}
+		std::optional<Extent> placed = place(info, app, map, disk.block_size());
+		if (!placed) { return EXIT_FAILURE; }
+		extent = *placed;
+		// CHS addresses past 8 GiB can't be represented, modern tools write the maximum and rely on the LBAs
+		record = {.bootIndicator = 0x00,
+				  .startingCHS = {0xFE, 0xFF, 0xFF},
+				  .OSType = *OSType,
+				  .endingCHS = {0xFE, 0xFF, 0xFF},
+				  .startingLBA = uint32_t(extent.first),
+				  .sizeInLBA = uint32_t(extent.last - extent.first + 1)};
+	} else if (operation == Operation::DELETE) {
+		record = {};
+	} else {
+		std::optional<Extent> resized = resize_extent(info, extent, map, disk.block_size());
+		if (!resized) { return EXIT_FAILURE; }
+		extent = *resized;
+		record.sizeInLBA = uint32_t(extent.last - extent.first + 1);
+	}
+
+	disk.write_at(0, &mbr, sizeof(mbr));
+	disk.sync(0, 1);
+	if (operation == Operation::DELETE) {
+		std::cout << "Deleted partition " << index + 1 << "\n";
+	} else {
+		print_extent(operation == Operation::ADD ? "Added" : "Resized", index + 1, extent, disk.block_size());
+	}
+	return EXIT_SUCCESS;
+}
+
+int mdfs::do_part(mdfs::PartInfo &info, const CLI::App *app) {
+	const CLI::App *sub = app->get_subcommands().front();
+	Operation operation = sub->get_name() == "add" ? Operation::ADD
+						  : sub->get_name() == "delete" ? Operation::DELETE
+														: Operation::RESIZE;
+	if (!std::filesystem::exists(info.inFile)) {
+		std::cerr << "Specified disk image doesn't exist.\n";
+		return EXIT_FAILURE;
+	}
+	if (operation != Operation::ADD && info.index == 0) {
+		std::cerr << "Partitions are numbered from 1.\n";
+		return EXIT_FAILURE;
+	}
+
+	mdfs::BlockDevice disk(info.inFile, info.sectorSize ? info.sectorSize : 512, std::ios::in | std::ios::out,
+						   info.io);
+	mdfs::PartitionTableReader reader(disk);
+	mdfs::Result result = sub->count("--sector_size") ? reader.read() : reader.read_detecting_sector_size();
+	if (result != mdfs::Result::SUCCESS) {
+		std::cerr << "Disk image is too small to hold a partition table.\n";
+		return EXIT_FAILURE;
+	}
+
+	if (reader.active()) { return edit_gpt(info, sub, operation, disk); }
+	if (reader.has_mbr_signature() && !reader.has_protective_mbr()) {
+		return edit_mbr(info, sub, operation, disk, reader.mbr());
+	}
+	std::cerr << "Disk image has no usable partition table, create one with initpart first.\n";
+	return EXIT_FAILURE;
+}
@@ -0,0 +1,121 @@
+#include <algorithm>
+#include <cerrno>
+#include <common/stream_writer.hpp>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <part/format.hpp>
+#include <part/layout.hpp>
+#include <part/stream.hpp>
+#include <stdexcept>
+#include <sys/stat.h>
+#include <unistd.h>
+
+CLI::App *mdfs::make_stream_app(mdfs::StreamInfo &info, CLI::App &app) {
+	CLI::App *stream = app.add_subcommand("stream", "Writes a whole disk image built from a layout file front to back, "
+													"so it can go straight into a pipe");
+	stream->add_option("-l,--layout", info.layoutFile, "Layout file")->required();
+	stream->add_option("--size", info.size, "Size of the image, like 8G")->required();
+	stream->add_option("-o,--output", info.output, "File to write the image to, - writes to stdout")
+			->default_str("-");
+	stream->add_option("--chunk", info.chunkSize, "Largest single write")->default_str("1M");
+	return stream;
+}
+
+namespace {
+// a partition that starts with the contents of a file
+struct Payload {
+	uint64_t firstLBA;
+	uint64_t lastLBA;
+	int fd;
+	uint64_t size;
+};
+
+class PayloadFiles {
+public:
+	~PayloadFiles() {
+		for (const Payload &payload : payloads) { close(payload.fd); }
+	}
+	std::vector<Payload> payloads;
+};
+}// namespace
+
+// every source is opened and checked before the first byte goes out, a stream can't be taken back
+static void open_payloads(const mdfs::Layout &layout, const mdfs::LayoutTables &tables, PayloadFiles &files) {
+	for (const mdfs::PlacedPartition &placed : tables.partitions) {
+		const std::string &source = layout.partitions[placed.index].source;
+		if (source.empty()) { continue; }
+		int fd = open(source.c_str(), O_RDONLY | O_CLOEXEC);
+		if (fd < 0) { throw std::runtime_error("Failed to open " + source + ": " + strerror(errno)); }
+		struct stat st;
+		if (fstat(fd, &st) != 0) {
+			close(fd);
+			throw std::runtime_error("Failed to stat " + source + ": " + strerror(errno));
+		}
+		files.payloads.push_back({placed.firstLBA, placed.lastLBA, fd, uint64_t(st.st_size)});
+		uint64_t capacity = (placed.lastLBA - placed.firstLBA + 1) * layout.sectorSize;
+		if (uint64_t(st.st_size) > capacity) {
+			throw std::runtime_error(source + " doesn't fit in partition " + std::to_string(placed.index + 1) + " (" +
+									 mdfs::size_string(uint64_t(st.st_size)) + " into " +
+									 mdfs::size_string(capacity) + ")");
+		}
+	}
+	std::sort(files.payloads.begin(), files.payloads.end(),
+			  [](const Payload &a, const Payload &b) { return a.firstLBA < b.firstLBA; });
+}
+
+// the tables come out of build_layout with every CRC filled in, so the image is just the primary region, the
+// payloads in LBA order with zeros in between, and the backup region
+static void stream_image(const mdfs::Layout &layout, const mdfs::LayoutTables &tables, const PayloadFiles &files,
+						 mdfs::StreamWriter &writer) {
+	size_t sectorSize = layout.sectorSize;
+	writer.write(tables.primary.data(), tables.primary.size());
+	uint64_t LBA = tables.primary.size() / sectorSize;
+	for (const Payload &payload : files.payloads) {
+		writer.write_zeros((payload.firstLBA - LBA) * sectorSize);
+		writer.write_file(payload.fd, 0, payload.size);
+		writer.write_zeros((payload.lastLBA - payload.firstLBA + 1) * sectorSize - payload.size);
+		LBA = payload.lastLBA + 1;
+	}
+	writer.write_zeros((tables.backupLBA - LBA) * sectorSize);
+	writer.write(tables.backup.data(), tables.backup.size());
+	writer.finish();
+}
+
+int mdfs::do_stream(mdfs::StreamInfo &info, [[maybe_unused]] const CLI::App *app) {
+	Layout layout;
+	try {
+		layout = read_layout_file(info.layoutFile);
+	} catch (const std::exception &e) {
+		std::cerr << info.layoutFile << ": " << e.what() << "\n";
+		return EXIT_FAILURE;
+	}
+
+	int out = -1;
+	try {
+		std::optional<uint64_t> size = parse_size(info.size, layout.sectorSize);
+		if (!size || *size < layout.sectorSize) { throw std::runtime_error("Invalid image size " + info.size); }
+		std::optional<uint64_t> chunkSize = parse_size(info.chunkSize, layout.sectorSize);
+		if (!chunkSize || *chunkSize == 0) { throw std::runtime_error("Invalid chunk size " + info.chunkSize); }
+
+		LayoutTables tables = build_layout(layout, *size / layout.sectorSize);
+		PayloadFiles files;
+		open_payloads(layout, tables, files);
+
+		if (info.output == "-") {
+			if (isatty(STDOUT_FILENO)) { throw std::runtime_error("Refusing to write a disk image to a terminal"); }
+			out = STDOUT_FILENO;
+		} else {
+			out = open(info.output.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+			if (out < 0) { throw std::runtime_error("Failed to open " + info.output + ": " + strerror(errno)); }
+		}
+		StreamWriter writer(out, *chunkSize);
+		stream_image(layout, tables, files, writer);
+	} catch (const std::exception &e) {
+		std::cerr << e.what() << "\n";
+		if (out > STDOUT_FILENO) { close(out); }
+		return EXIT_FAILURE;
+	}
+	if (out > STDOUT_FILENO) { close(out); }
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,264 @@
+#include <algorithm>
+#include <atomic>
+#include <common/block_device.hpp>
+#include <common/gpt.hpp>
+#include <common/table_reader.hpp>
+#include <cstring>
+#include <iostream>
+#include <part/format.hpp>
+#include <part/io_options.hpp>
+#include <part/verify.hpp>
+#include <sstream>
+#include <thread>
+
+CLI::App *mdfs::make_verify_app(mdfs::VerifyInfo &info, CLI::App &app) {
+	CLI::App *verify = app.add_subcommand("verify", "Checks the partition tables of one or more disk images");
+	verify->add_option("images", info.images, "Disk images to verify")->required();
+	verify->add_option("-s,--sector_size", info.sectorSize, "Sector size to use")->default_str("Auto detect");
+	verify->add_option("-j,--jobs", info.jobs, "Number of images verified at once")->default_str("All CPUs");
+	verify->add_option("-f,--format", info.format, "Report format, json prints one object per image and line")
+			->check(CLI::IsMember({"text", "json"}))
+			->default_str("text");
+	mdfs::add_io_options(verify, info.io);
+	verify->get_option("--io-engine")->default_str("mmap");
+	return verify;
+}
+
+static uint64_t entry_array_lbas(const mdfs::HeaderGPT &header, size_t sectorSize) {
+	uint64_t bytes = uint64_t(header.numberOfPartitionEntries) * header.sizeOfPartitionEntries;
+	return mdfs::align_up<uint64_t>(bytes, sectorSize) / sectorSize;
+}
+
+// the records have to match what build_protective_mbr writes for an image of this size, boot code is free
+static void check_mbr(const mdfs::PartitionTableReader &reader, mdfs::BlockDevice &disk, mdfs::VerifyReport &report) {
+	if (!reader.has_mbr_signature()) {
+		report.issues.push_back({"mbr", "missing the 0x55AA boot signature"});
+		return;
+	}
+	mdfs::mbr::MBR expected = mdfs::build_protective_mbr(disk.size_b(), disk.block_size());
+	for (size_t i = 0; i < 4; i++) {
+		const mdfs::mbr::PartitionRecord &record = reader.mbr().partitionRecords[i];
+		const mdfs::mbr::PartitionRecord &wanted = expected.partitionRecords[i];
+		if (memcmp(&record, &wanted, sizeof(record)) == 0) { continue; }
+		std::ostringstream message;
+		message << "partition record " << i + 1 << " has type 0x" << std::hex << +record.OSType << std::dec
+				<< ", first LBA " << record.startingLBA << " and " << record.sizeInLBA
+				<< " sectors, a protective MBR has type 0x" << std::hex << +wanted.OSType << std::dec << ", first LBA "
+				<< wanted.startingLBA << " and " << wanted.sizeInLBA << " sectors";
+		report.issues.push_back({"mbr", message.str()});
+	}
+}
+
+static void check_copy(const char *name, const mdfs::GptCopy &copy, mdfs::VerifyReport &report) {
+	if (copy.valid()) { return; }
+	report.issues.push_back({name, std::string("header at LBA ") + std::to_string(copy.headerLBA) + ": " +
+										   mdfs::gpt_status_name(copy.status)});
+}
+
+// the backup carries the same table, only its own location, the alternate LBA and the entry array location differ
+static void check_mirror(const mdfs::GptCopy &primary, const mdfs::GptCopy &backup, mdfs::VerifyReport &report) {
+	const mdfs::HeaderGPT &p = *primary.header;
+	const mdfs::HeaderGPT &b = *backup.header;
+	auto mismatch = [&report](const char *field, uint64_t primaryValue, uint64_t backupValue) {
+		if (primaryValue == backupValue) { return; }
+		report.issues.push_back({"mirror", std::string(field) + " is " + std::to_string(primaryValue) +
+												   " in the primary header and " + std::to_string(backupValue) +
+												   " in the backup"});
+	};
+	mismatch("alternate LBA of the backup", p.myLBA, b.alternateLBA);
+	mismatch("revision", p.revision, b.revision);
+	mismatch("header size", p.headerSize, b.headerSize);
+	mismatch("first usable LBA", p.firstUsableLBA, b.firstUsableLBA);
+	mismatch("last usable LBA", p.lastUsableLBA, b.lastUsableLBA);
+	mismatch("entry count", p.numberOfPartitionEntries, b.numberOfPartitionEntries);
+	mismatch("entry size", p.sizeOfPartitionEntries, b.sizeOfPartitionEntries);
+	mismatch("entry array CRC", p.partitionEntryArrayCRC32, b.partitionEntryArrayCRC32);
+	if (memcmp(&p.diskGUID, &b.diskGUID, sizeof(GUID)) != 0) {
+		report.issues.push_back({"mirror", "disk GUID is " + mdfs::guid_string(p.diskGUID) +
+												   " in the primary header and " + mdfs::guid_string(b.diskGUID) +
+												   " in the backup"});
+	}
+	if (primary.entries.size() == backup.entries.size() &&
+		memcmp(primary.entries.data(), backup.entries.data(), primary.entries.size()) != 0) {
+		report.issues.push_back({"mirror", "entry arrays differ"});
+	}
+}
+
+// the usable range has to sit between the primary entry array and the backup one, the backup has to be last
+static void check_bounds(const mdfs::PartitionTableReader &reader, mdfs::BlockDevice &disk,
+						 mdfs::VerifyReport &report) {
+	auto fail = [&report](const std::string &message) { report.issues.push_back({"bounds", message}); };
+	const mdfs::HeaderGPT &header = *reader.active()->header;
+	if (header.firstUsableLBA > header.lastUsableLBA + 1) {
+		fail("first usable LBA " + std::to_string(header.firstUsableLBA) + " is past the last usable LBA " +
+			 std::to_string(header.lastUsableLBA));
+	}
+	if (header.lastUsableLBA >= disk.size_lba()) {
+		fail("last usable LBA " + std::to_string(header.lastUsableLBA) + " is past the end of the image");
+	}
+	if (reader.primary().valid()) {
+		const mdfs::HeaderGPT &primary = *reader.primary().header;
+		uint64_t entriesEnd = primary.partitionEntryLBA + entry_array_lbas(primary, disk.block_size());
+		if (primary.alternateLBA != disk.size_lba() - 1) {
+			fail("backup header is at LBA " + std::to_string(primary.alternateLBA) + " instead of the last LBA " +
+				 std::to_string(disk.size_lba() - 1));
+		}
+		if (primary.partitionEntryLBA <= primary.myLBA || entriesEnd > primary.firstUsableLBA) {
+			fail("primary entry array at LBA " + std::to_string(primary.partitionEntryLBA) +
+				 " isn't between the primary header and the first usable LBA");
+		}
+	}
+	if (reader.backup().valid()) {
+		const mdfs::HeaderGPT &backup = *reader.backup().header;
+		uint64_t entriesEnd = backup.partitionEntryLBA + entry_array_lbas(backup, disk.block_size());
+		if (backup.partitionEntryLBA <= backup.lastUsableLBA || entriesEnd > backup.myLBA) {
+			fail("backup entry array at LBA " + std::to_string(backup.partitionEntryLBA) +
+				 " isn't between the last usable LBA and the backup header");
+		}
+	}
+}
+
+struct Extent {
+	uint64_t first;
+	uint64_t last;
+	// 1 based, like the partition numbers of inspect and part
+	uint32_t index;
+};
+
+// the extents are sorted by their first LBA and swept once, keeping the one that reaches furthest so far. any extent
+// starting at or before that end overlaps it
+static void check_overlaps(std::vector<Extent> &extents, const char *kind, mdfs::VerifyReport &report) {
+	std::sort(extents.begin(), extents.end(), [](const Extent &a, const Extent &b) { return a.first < b.first; });
+	const Extent *furthest = nullptr;
+	for (const Extent &extent : extents) {
+		if (furthest && extent.first <= furthest->last) {
+			report.issues.push_back({"overlap", std::string(kind) + " " + std::to_string(extent.index) + " overlaps " +
+														kind + " " + std::to_string(furthest->index) + " from LBA " +
+														std::to_string(extent.first) + " to " +
+														std::to_string(std::min(extent.last, furthest->last))});
+		}
+		if (!furthest || extent.last > furthest->last) { furthest = &extent; }
+	}
+}
+
+// out of range entries are reported on their own, the rest are checked for overlaps
+static void check_partitions(const mdfs::GptCopy &gpt, mdfs::VerifyReport &report) {
+	const mdfs::HeaderGPT &header = *gpt.header;
+	std::vector<Extent> extents;
+	for (auto [index, entry] : gpt.used_entries()) {
+		report.partitionCount++;
+		std::string name = "entry " + std::to_string(index + 1) + " (LBA " + std::to_string(entry->startingLBA) +
+						   " - " + std::to_string(entry->endingLBA) + ")";
+		if (entry->startingLBA > entry->endingLBA) {
+			report.issues.push_back({"range", name + " ends before it starts"});
+		} else if (entry->startingLBA < header.firstUsableLBA || entry->endingLBA > header.lastUsableLBA) {
+			report.issues.push_back({"range", name + " is outside the usable LBAs " +
+													  std::to_string(header.firstUsableLBA) + " - " +
+													  std::to_string(header.lastUsableLBA)});
+		} else {
+			extents.push_back({entry->startingLBA, entry->endingLBA, index + 1});
+		}
+	}
+
+	check_overlaps(extents, "entry", report);
+}
+
+// an MBR partitioned image, used records have to lie between LBA 1 and the end of the image
+static void check_mbr_partitions(const mdfs::mbr::MBR &mbr, mdfs::BlockDevice &disk, mdfs::VerifyReport &report) {
+	std::vector<Extent> extents;
+	for (uint32_t i = 0; i < 4; i++) {
+		const mdfs::mbr::PartitionRecord &record = mbr.partitionRecords[i];
+		if (record.OSType == 0x00) { continue; }
+		report.partitionCount++;
+		uint64_t first = record.startingLBA;
+		uint64_t end = first + record.sizeInLBA;
+		std::string name = "partition record " + std::to_string(i + 1) + " (LBA " + std::to_string(first) + " - " +
+						   std::to_string(end - 1) + ")";
+		if (record.sizeInLBA == 0) {
+			report.issues.push_back({"range", "partition record " + std::to_string(i + 1) + " is empty"});
+		} else if (first < 1 || end > disk.size_lba()) {
+			report.issues.push_back(
+					{"range", name + " is outside the usable LBAs 1 - " + std::to_string(disk.size_lba() - 1)});
+		} else {
+			extents.push_back({first, end - 1, i + 1});
+		}
+	}
+	check_overlaps(extents, "partition record", report);
+}
+
+mdfs::VerifyReport mdfs::verify_image(const std::string &path, size_t sectorSize, const mdfs::IoEngineOptions &io) {
+	VerifyReport report;
+	report.image = path;
+	try {
+		mdfs::BlockDevice disk(path, sectorSize ? sectorSize : 512, std::ios::in, io);
+		mdfs::PartitionTableReader reader(disk);
+		if ((sectorSize ? reader.read() : reader.read_detecting_sector_size()) != mdfs::Result::SUCCESS) {
+			report.issues.push_back({"image", "too small to hold a partition table"});
+			return report;
+		}
+		report.sectorSize = disk.block_size();
+
+		// without a GPT header a regular MBR is the partition table, not a damaged protective MBR
+		if (reader.has_mbr_signature() && !reader.has_protective_mbr() && !reader.active()) {
+			check_mbr_partitions(reader.mbr(), disk, report);
+			return report;
+		}
+		check_mbr(reader, disk, report);
+		check_copy("primary", reader.primary(), report);
+		check_copy("backup", reader.backup(), report);
+		if (!reader.active()) { return report; }
+		if (reader.primary().valid() && reader.backup().valid()) {
+			check_mirror(reader.primary(), reader.backup(), report);
+		}
+		check_bounds(reader, disk, report);
+		check_partitions(*reader.active(), report);
+	} catch (const std::exception &e) {
+		report.issues.push_back({"image", e.what()});
+	}
+	return report;
+}
+
+static void print_report(const mdfs::VerifyReport &report, bool json) {
+	std::ostringstream out;
+	if (json) {
+		out << "{\"image\":" << mdfs::json_string(report.image) << ",\"ok\":" << (report.ok() ? "true" : "false")
+			<< ",\"sectorSize\":" << report.sectorSize << ",\"partitions\":" << report.partitionCount
+			<< ",\"issues\":[";
+		for (size_t i = 0; i < report.issues.size(); i++) {
+			out << (i ? "," : "") << "{\"check\":\"" << report.issues[i].check
+				<< "\",\"message\":" << mdfs::json_string(report.issues[i].message) << "}";
+		}
+		out << "]}\n";
+	} else {
+		out << report.image << ": " << (report.ok() ? "OK" : "FAILED") << "\n";
+		for (const mdfs::VerifyIssue &issue : report.issues) {
+			out << "  " << issue.check << ": " << issue.message << "\n";
+		}
+	}
+	std::cout << out.str();
+}
+
+int mdfs::do_verify(mdfs::VerifyInfo &info, [[maybe_unused]] const CLI::App *app) {
+	std::vector<VerifyReport> reports(info.images.size());
+	size_t jobs = info.jobs ? info.jobs : std::max(1u, std::thread::hardware_concurrency());
+	jobs = std::min(jobs, info.images.size());
+
+	// every worker takes the next unclaimed image until none are left
+	std::atomic<size_t> next = 0;
+	auto worker = [&]() {
+		for (size_t i = next++; i < info.images.size(); i = next++) {
+			reports[i] = verify_image(info.images[i], info.sectorSize, info.io);
+		}
+	};
+	std::vector<std::thread> threads;
+	for (size_t i = 1; i < jobs; i++) { threads.emplace_back(worker); }
+	worker();
+	for (std::thread &thread : threads) { thread.join(); }
+
+	bool allOk = true;
+	for (const VerifyReport &report : reports) {
+		print_report(report, info.format == "json");
+		allOk = allOk && report.ok();
+	}
+	return allOk ? EXIT_SUCCESS : EXIT_FAILURE;
+}